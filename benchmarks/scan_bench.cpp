@@ -0,0 +1,155 @@
+// Microbenchmark for the delimiter-scanning kernels in src/scan.cpp.
+//
+// Compares the parsers' byte-at-a-time/memchr loops with the dispatched kernels on
+// generated manifest and depfile text. Build and run from the repository root:
+//
+//   c++ -std=c++23 -O3 -Iinclude benchmarks/scan_bench.cpp src/scan.cpp -o scan_bench && ./scan_bench
+
+#include "cbe/depfile.hpp"
+#include "cbe/scan.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+
+using namespace catalyst;
+
+namespace {
+
+constexpr int TUNABLE__rounds = 20;
+
+std::string generate_manifest(size_t steps) {
+    std::mt19937 rng(42);
+    std::string text = "DEF|cxx|clang++\nDEF|cxxflags|-O2 -Wall\n";
+    for (size_t i = 0; i < steps; ++i) {
+        text += "cxx|src/module_" + std::to_string(i) + ".cpp";
+        for (size_t h = 0, n = rng() % 8; h < n; ++h)
+            text += ",!include/generated/header_" + std::to_string(rng() % 1000) + ".hpp";
+        text += "|build/obj/module_" + std::to_string(i) + ".o\n";
+    }
+    return text;
+}
+
+std::string generate_depfile(size_t deps) {
+    std::mt19937 rng(7);
+    std::string text = "build/obj/module_0.o: src/module_0.cpp";
+    for (size_t i = 0; i < deps; ++i) {
+        text += i % 3 == 0 ? " \\\n  " : " ";
+        text += "/usr/include/c++/13/bits/header_" + std::to_string(rng() % 5000) + ".h";
+    }
+    return text + "\n";
+}
+
+/** @brief The manifest line split as parse_chunk did it: memchr for the newline, then each pipe. */
+size_t split_lines_memchr(std::string_view content) {
+    size_t sum = 0;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string_view::npos)
+            end = content.size();
+        std::string_view line = content.substr(start, end - start);
+        size_t first = line.find('|');
+        size_t second = line.find('|', first + 1);
+        sum += first + second + end;
+        start = end + 1;
+    }
+    return sum;
+}
+
+/** @brief The same split with find_pipe_or_newline, as parse_chunk does it now. */
+size_t split_lines_kernel(std::string_view content) {
+    size_t sum = 0;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t pipes[2] = {std::string_view::npos, std::string_view::npos};
+        size_t pos = find_pipe_or_newline(content, start);
+        for (size_t &pipe : pipes) {
+            if (pos == content.size() || content[pos] == '\n')
+                break;
+            pipe = pos - start;
+            pos = find_pipe_or_newline(content, pos + 1);
+        }
+        size_t end = pos < content.size() && content[pos] != '\n' ? content.find('\n', pos) : pos;
+        if (end == std::string_view::npos)
+            end = content.size();
+        sum += pipes[0] + pipes[1] + end;
+        start = end + 1;
+    }
+    return sum;
+}
+
+/** @brief The depfile token scan as parseDepfileContent did it, one byte at a time. */
+size_t tokens_bytewise(std::string_view content) {
+    size_t sum = 0;
+    const char *ptr = content.data();
+    const char *end = ptr + content.size();
+    while (ptr < end) {
+        while (ptr < end && static_cast<unsigned char>(*ptr) <= ' ')
+            ptr++;
+        const char *start = ptr;
+        while (ptr < end) {
+            unsigned char c = *ptr;
+            if (c <= ' ' || c == '\\')
+                break;
+            ptr++;
+        }
+        sum += static_cast<size_t>(ptr - start);
+        if (ptr < end && *ptr == '\\')
+            ptr++;
+    }
+    return sum;
+}
+
+/** @brief The same scan with find_depfile_break. */
+size_t tokens_kernel(std::string_view content) {
+    size_t sum = 0;
+    size_t pos = 0;
+    while (pos < content.size()) {
+        while (pos < content.size() && static_cast<unsigned char>(content[pos]) <= ' ')
+            pos++;
+        const size_t start = pos;
+        pos = find_depfile_break(content, pos);
+        sum += pos - start;
+        if (pos < content.size() && content[pos] == '\\')
+            pos++;
+    }
+    return sum;
+}
+
+template <typename F> void bench(const char *name, std::string_view input, F &&fn) {
+    size_t result = fn(input);
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < TUNABLE__rounds; ++i) {
+        if (fn(input) != result)
+            std::printf("%s: result changed between rounds\n", name);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    const double mb = static_cast<double>(input.size()) * TUNABLE__rounds / (1024.0 * 1024.0);
+    std::printf("  %-28s %8.1f MB/s  (checksum %zu)\n", name, mb / elapsed.count(), result);
+}
+
+} // namespace
+
+int main() {
+    std::printf("kernels: %.*s\n", static_cast<int>(scan_kernel_name().size()), scan_kernel_name().data());
+
+    const std::string manifest = generate_manifest(200'000);
+    std::printf("manifest (%zu bytes):\n", manifest.size());
+    bench("memchr line + pipes", manifest, split_lines_memchr);
+    bench("find_pipe_or_newline", manifest, split_lines_kernel);
+
+    const std::string depfile = generate_depfile(500'000);
+    std::printf("depfile (%zu bytes):\n", depfile.size());
+    bench("byte loop", depfile, tokens_bytewise);
+    bench("find_depfile_break", depfile, tokens_kernel);
+    bench("parseDepfileContent", depfile, [](std::string_view content) {
+        size_t sum = 0;
+        parseDepfileContent(content, [&](std::string_view dep) { sum += dep.size(); });
+        return sum;
+    });
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Microbenchmark for process spawning: `process_exec` against the `reproc::run` path it replaced.
+//
+// Spawns `true` repeatedly from several threads, optionally after touching a large heap so
+// that the cost of duplicating the address space (fork) shows up. Build and run from the
+// repository root:
+//
+//   c++ -std=c++23 -O2 -Iinclude benchmarks/spawn_bench.cpp src/process_exec.cpp -lreproc++ -lreproc -pthread
+//       -o spawn_bench && ./spawn_bench [spawns] [threads] [heap MiB]
+
+#include "cbe/process_exec.hpp"
+
+#include <reproc++/run.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+
+/** @brief The old `process_exec`: reproc with output redirected to the parent. */
+int spawn_reproc() {
+    reproc::options options;
+    options.redirect.out.type = reproc::redirect::parent;
+    options.redirect.err.type = reproc::redirect::parent;
+    auto [status, ec] = reproc::run(std::vector<std::string>{"true"}, options);
+    return ec ? -1 : status;
+}
+
+int spawn_process_exec() {
+    auto res = process_exec(std::vector<std::string>{"true"});
+    return res ? *res : -1;
+}
+
+template <typename F> void bench(const char *name, size_t spawns, size_t threads, F &&spawn) {
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> failures = 0;
+    auto begin = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> pool;
+        pool.reserve(threads);
+        for (size_t t = 0; t < threads; ++t) {
+            pool.emplace_back([&] {
+                while (next.fetch_add(1) < spawns) {
+                    if (spawn() != 0)
+                        failures++;
+                }
+            });
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    std::printf("  %-14s %8.0f spawns/s  (%zu failed)\n",
+                name,
+                static_cast<double>(spawns) / elapsed.count(),
+                failures.load());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const size_t spawns = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000;
+    const size_t threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+    const size_t heap_mib = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 0;
+
+    // Touched so the pages are really mapped, like a resident graph would be.
+    auto heap = std::make_unique_for_overwrite<char[]>(heap_mib << 20);
+    std::memset(heap.get(), 1, heap_mib << 20);
+
+    std::printf("%zu spawns of `true` on %zu threads, %zu MiB heap:\n", spawns, threads, heap_mib);
+    bench("reproc::run", spawns, threads, spawn_reproc);
+    bench("process_exec", spawns, threads, spawn_process_exec);
+    return 0;
+}
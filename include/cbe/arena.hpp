@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace catalyst {
+
+/**
+ * @brief Append-only storage for strings that must outlive the buffer they came from.
+ *
+ * Strings are copied back to back into large blocks, so views returned by `copy` stay
+ * valid (also across moves of the arena) until the arena is destroyed.
+ */
+class StringArena {
+public:
+    static constexpr size_t TUNABLE__block_size = 64 * 1024;
+
+    std::string_view copy(std::string_view str) {
+        if (str.size() > remaining_) {
+            const size_t size = std::max(TUNABLE__block_size, str.size());
+            blocks_.push_back(std::make_unique_for_overwrite<char[]>(size));
+            cursor_ = blocks_.back().get();
+            remaining_ = size;
+        }
+        if (!str.empty())
+            std::memcpy(cursor_, str.data(), str.size());
+        std::string_view stored(cursor_, str.size());
+        cursor_ += str.size();
+        remaining_ -= str.size();
+        return stored;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *cursor_ = nullptr;
+    size_t remaining_ = 0;
+};
+
+} // namespace catalyst
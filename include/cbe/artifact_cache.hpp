@@ -0,0 +1,98 @@
+#pragma once
+
+#include "cbe/hash.hpp"
+#include "cbe/utility.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace catalyst {
+
+/**
+ * @brief Local content-addressed store of step outputs, shared by every checkout that points at it.
+ *
+ * A step is looked up in two levels. Its key (see `Executor::artifact_key`) covers the command
+ * and the contents of its explicit inputs. Under `manifests/`, the key names the inputs the
+ * step's depfile listed the last time it was stored. Hashing the key together with the current
+ * contents of those files gives the name of the entry under `objects/`, which holds the output
+ * and its depfile as zstd frames. A changed header therefore misses, however the step's
+ * dependencies are discovered.
+ *
+ * Files are written to a temporary name and renamed into place, so concurrent builds sharing
+ * the directory never see a partial entry. Restoring an entry touches it, and `trim` evicts
+ * the least recently used files once the directory exceeds its budget.
+ */
+class ArtifactCache {
+public:
+    /**
+     * @param dir The cache directory; created on first store.
+     * @param max_bytes The size `trim` keeps the directory under.
+     */
+    ArtifactCache(std::filesystem::path dir, uint64_t max_bytes);
+
+    /**
+     * @brief Restores the output (and depfile) stored for `key`. Thread-safe.
+     *
+     * The restored files replace any existing ones atomically. Counts a hit or a miss.
+     *
+     * @param depfile Where the step writes its depfile, if it writes one.
+     * @return Whether the entry existed and every file of it was restored.
+     */
+    bool restore(const Digest &key,
+                 const std::filesystem::path &output,
+                 const std::optional<std::filesystem::path> &depfile);
+
+    /**
+     * @brief Stores the output and depfile a step just produced under `key`. Thread-safe.
+     *
+     * Must be called before the depfile is consumed.
+     *
+     * @return Success, or why nothing was stored (e.g. a dependency could not be read).
+     */
+    Result<void> store(const Digest &key,
+                       const std::filesystem::path &output,
+                       const std::optional<std::filesystem::path> &depfile);
+
+    /**
+     * @brief Removes the least recently used files until the directory fits its budget.
+     *
+     * Scans the whole directory, so it does nothing unless this process stored something.
+     */
+    void trim();
+
+    size_t hits() const {
+        return hits_.load();
+    }
+
+    size_t misses() const {
+        return misses_.load();
+    }
+
+private:
+    std::filesystem::path manifest_path(const Digest &key) const;
+    std::filesystem::path object_path(const Digest &key) const;
+
+    /** @brief Hashes `key` with the current contents of `deps`; nothing if one cannot be read. */
+    static std::optional<Digest> object_key(const Digest &key, const std::vector<std::string> &deps);
+
+    /** @brief Writes `content` to a temporary file next to `path` and renames it over `path`. */
+    Result<void> write_atomically(const std::filesystem::path &path,
+                                  std::string_view content,
+                                  std::optional<std::filesystem::perms> perms = std::nullopt) const;
+
+    std::filesystem::path dir_;
+    uint64_t max_bytes_;
+    std::atomic<size_t> hits_ = 0;
+    std::atomic<size_t> misses_ = 0;
+    std::atomic<size_t> stored_ = 0;
+    uint64_t tmp_tag_; ///< Random, so processes sharing `dir_` never pick the same name.
+    mutable std::atomic<uint64_t> tmp_counter_ = 0;
+};
+
+} // namespace catalyst
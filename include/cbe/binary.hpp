@@ -23,4 +23,12 @@ Result<void> parse_bin(CBEBuilder &builder);
  */
 Result<void> emit_bin(CBEBuilder &builder);
 
+/**
+ * @brief Removes the binary cache, so the next run parses the text manifest and the
+ * current `.d` files again.
+ *
+ * Called when a step's discovered dependencies no longer match the cached graph.
+ */
+void invalidate_bin();
+
 } // namespace catalyst
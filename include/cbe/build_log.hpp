@@ -0,0 +1,111 @@
+#pragma once
+
+#include "cbe/hash.hpp"
+#include "cbe/mmap.hpp"
+#include "cbe/utility.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace catalyst {
+
+/**
+ * @brief Persistent, append-only record of how each output was last built.
+ *
+ * Every successful step appends `<output>|<command_hash>` to the log (`.catalyst.log`
+ * by default). On the next run the recorded hash is compared against the hash of the
+ * step's current expanded command, so editing one line of the manifest only
+ * invalidates the steps whose command actually changed. In `--hash` mode the record
+ * also carries the digest of the step's inputs, as `<output>|<command_hash>#<digest>`.
+ * A `restat` step whose output came out unchanged keeps its old mtime, so its record
+ * ends in `@<mtime_ns>`: the mtime the output would have had, for its own staleness check.
+ *
+ * Later records for the same output supersede earlier ones. When the number of
+ * superseded records grows large, the log is compacted on open.
+ */
+class BuildLog {
+public:
+    /** @brief How an output was last built. */
+    struct Record {
+        uint64_t command_hash = 0;
+        std::optional<Digest> inputs_digest;                     ///< In `--hash` mode.
+        std::optional<std::filesystem::file_time_type> built_at; ///< If the output kept an older mtime.
+    };
+
+    /**
+     * @brief Loads an existing log. A missing or unreadable log is treated as empty.
+     * @param path The path to the log file.
+     */
+    explicit BuildLog(const std::filesystem::path &path);
+
+    /**
+     * @brief Returns the command hash recorded for `output`, if any.
+     *
+     * Safe to call from many threads, but not while `record` may run.
+     */
+    std::optional<uint64_t> command_hash(std::string_view output) const {
+        if (auto it = entries_.find(output); it != entries_.end()) {
+            return it->second.command_hash;
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Returns the digest of the inputs recorded for `output`, if any.
+     *
+     * Safe to call from many threads, but not while `record` may run.
+     */
+    std::optional<Digest> inputs_digest(std::string_view output) const {
+        if (auto it = entries_.find(output); it != entries_.end()) {
+            return it->second.inputs_digest;
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Returns when `output` was last built, if it kept an older mtime (see `Record::built_at`).
+     *
+     * Safe to call from many threads, but not while `record` may run.
+     */
+    std::optional<std::filesystem::file_time_type> built_at(std::string_view output) const {
+        if (auto it = entries_.find(output); it != entries_.end()) {
+            return it->second.built_at;
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Opens the log for appending, compacting it first if needed. Does nothing if already open.
+     * @return Success or error.
+     */
+    Result<void> open_for_append();
+
+    /**
+     * @brief Appends a record for `output` and updates the in-memory entry. Thread-safe.
+     * @param output The output path of the finished step.
+     * @param record How it was built.
+     */
+    void record(std::string_view output, const Record &record);
+
+private:
+    Result<void> compact();
+
+    std::filesystem::path path_;
+    std::shared_ptr<MappedFile> log_file_keep_alive_;
+    std::unordered_map<std::string_view, Record> entries_;
+    std::deque<std::string> recorded_outputs_; ///< Owns keys of `entries_` first seen in `record`.
+    size_t total_records_ = 0;
+
+    std::mutex write_mtx_;
+    std::ofstream out_;
+};
+
+} // namespace catalyst
@@ -27,10 +27,11 @@ public:
     }
     
     /**
-     * @brief Returns the built graph by moving it out of the builder.
+     * @brief Finalizes the graph and moves it out of the builder.
      * @return The completed `BuildGraph`.
      */
     BuildGraph &&emit_graph() {
+        graph_.finalize();
         return std::move(graph_);
     }
 
@@ -51,10 +52,31 @@ public:
         graph_.add_resource(std::move(res));
     }
 
+    /**
+     * @brief Sets the dependency log the graph reads discovered inputs from. Call before parsing.
+     * @param path The log's path.
+     */
+    void set_deps_file(std::filesystem::path path) {
+        graph_.set_deps_file(std::move(path));
+    }
+
     const Definitions &definitions() const {
         return definitions_;
     }
 
+    /**
+     * @brief Declares a resource pool. The first declaration of a name wins.
+     * @param name The name of the pool.
+     * @param depth How many of its steps may run at once.
+     */
+    void add_pool(std::string_view name, size_t depth) {
+        pools_.emplace(name, depth);
+    }
+
+    const Pools &pools() const {
+        return pools_;
+    }
+
     friend Result<void> parse(CBEBuilder &, const std::filesystem::path &);
     friend Result<void> parse_bin(CBEBuilder &);
     friend Result<void> emit_bin(CBEBuilder &);
@@ -62,6 +84,7 @@ public:
 private:
     BuildGraph graph_;
     Definitions definitions_;
+    Pools pools_;
 };
 
 } // namespace catalyst
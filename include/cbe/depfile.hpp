@@ -0,0 +1,89 @@
+#pragma once
+
+#include "cbe/scan.hpp"
+
+#include <cstring>
+#include <string_view>
+
+namespace catalyst {
+
+/**
+ * @brief Parses the contents of a Makefile-style dependency file (.d).
+ *
+ * This parser handles line continuations (\) and escaped spaces.
+ * It invokes the callback for each dependency found.
+ *
+ * @param content The contents of the dependency file.
+ * @param callback A callable that accepts a std::string_view for each dependency.
+ */
+template <typename F> void parseDepfileContent(std::string_view content, F &&callback) {
+    if (content.empty())
+        return;
+
+    const char *ptr = content.data();
+    const char *end = ptr + content.size();
+
+    // 1. Skip to deps, ignoring final output
+    const char *colon = static_cast<const char *>(std::memchr(ptr, ':', end - ptr));
+    if (!colon)
+        return;
+    ptr = colon + 1;
+
+    // Main parsing loop
+    while (ptr < end) {
+        while (ptr < end) {
+            unsigned char c = *ptr;
+            if (c > ' ' && c != '\\')
+                break;
+
+            if (c <= ' ') {
+                ptr++;
+            } else if (c == '\\') {
+                if (ptr + 1 < end && (ptr[1] == '\n' || ptr[1] == '\r')) {
+                    ptr++; // skip
+                    if (*ptr == '\r')
+                        ptr++;
+                    if (ptr < end && *ptr == '\n')
+                        ptr++;
+                } else {
+                    break; // Escaped character, part of a filename
+                }
+            }
+        }
+
+        if (ptr >= end)
+            break;
+
+        // Extract Token
+        const char *start = ptr;
+        ptr = content.data() + find_depfile_break(content, static_cast<size_t>(ptr - content.data()));
+
+        // Handle the edge case of an escaped space or line continuation within a token
+        if (ptr < end && *ptr == '\\') {
+            // If we hit a backslash, we fall back to a slower scan for this specific token
+            while (ptr < end) {
+                if (*ptr == '\\') {
+                    if (ptr + 1 >= end) {
+                        // Dangling backslash at EOF
+                        ++ptr;
+                        break;
+                    }
+                    if (ptr[1] == '\n' || ptr[1] == '\r') {
+                        break; // line continuation
+                    }
+                    ptr += 2; // Safe: we know ptr + 1 < end
+                } else if (static_cast<unsigned char>(*ptr) <= ' ') {
+                    break;
+                } else {
+                    ptr++;
+                }
+            }
+        }
+
+        if (ptr > start) {
+            callback(std::string_view(start, ptr - start));
+        }
+    }
+}
+
+} // namespace catalyst
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "cbe/mmap.hpp"
+#include "cbe/utility.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace catalyst {
+
+/**
+ * @brief Persistent, append-only binary record of the dependencies each compile discovered.
+ *
+ * Replaces reading one `.d` file per step: after a `cc`/`cxx` step succeeds, its fresh `.d`
+ * is parsed once, recorded here and deleted. Graph construction then maps this one file.
+ *
+ * The file (`.catalyst.deps`) is an 8-byte signature followed by records, each a `uint32_t`
+ * head and a payload whose size (a multiple of 4) is in the low 31 bits of the head:
+ * - path record (top bit clear): the path, NUL-padded. Its id is the number of path
+ *   records before it.
+ * - deps record (top bit set): the output's path id, then the path ids of its dependencies.
+ *
+ * Later deps records for the same output supersede earlier ones. When the number of
+ * superseded records grows large, the log is compacted on open.
+ */
+class DepsLog {
+public:
+    /**
+     * @brief Loads an existing log. A missing or unreadable log is treated as empty, and a
+     * torn final record (e.g. from a killed build) is ignored.
+     * @param path The path to the log file.
+     */
+    explicit DepsLog(const std::filesystem::path &path);
+
+    /**
+     * @brief Returns the path ids recorded as dependencies of `output`, if any.
+     *
+     * Not safe to call while `record` may run.
+     */
+    std::optional<std::span<const uint32_t>> deps(std::string_view output) const {
+        if (auto it = ids_.find(output); it != ids_.end()) {
+            return deps_[it->second];
+        }
+        return std::nullopt;
+    }
+
+    /** @brief The path with the given id. */
+    std::string_view path(uint32_t id) const {
+        return paths_[id];
+    }
+
+    /**
+     * @brief Opens the log for appending, compacting it first if needed. Does nothing if already open.
+     * @return Success or error.
+     */
+    Result<void> open_for_append();
+
+    /**
+     * @brief Appends the dependencies of `output`, interning any new paths, and updates the
+     * in-memory entry. Thread-safe.
+     * @param output The output path of the finished step.
+     * @param deps The dependencies, as listed in its `.d` file.
+     * @return Success, or an error if the log is not open or the write failed.
+     */
+    Result<void> record(std::string_view output, std::span<const std::string_view> deps);
+
+private:
+    uint32_t intern(std::string_view path, std::string &buf);
+    Result<void> compact();
+
+    std::filesystem::path path_;
+    std::shared_ptr<MappedFile> log_file_keep_alive_;
+    size_t valid_size_ = 0; ///< Bytes of well-formed records in the mapped file.
+
+    std::vector<std::string_view> paths_;
+    std::unordered_map<std::string_view, uint32_t> ids_;
+    std::vector<std::optional<std::span<const uint32_t>>> deps_; ///< Per path id.
+    std::deque<std::string> recorded_paths_;                     ///< Owns paths first seen in `record`.
+    std::deque<std::vector<uint32_t>> recorded_deps_;            ///< Owns deps recorded in this run.
+    size_t total_records_ = 0;                                   ///< Deps records, including superseded ones.
+
+    std::mutex write_mtx_;
+    std::ofstream out_;
+};
+
+} // namespace catalyst
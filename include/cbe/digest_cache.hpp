@@ -0,0 +1,82 @@
+#pragma once
+
+#include "cbe/hash.hpp"
+#include "cbe/mmap.hpp"
+#include "cbe/stat_batch.hpp"
+#include "cbe/utility.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace catalyst {
+
+/**
+ * @brief Persistent table of file content digests, revalidated by stat.
+ *
+ * Each entry remembers the inode, size and mtime its file had when it was hashed. While a
+ * fresh stat still matches, the recorded digest is returned without reading the file, so a
+ * no-op build in `--hash` mode hashes nothing, and a checkout that rewrites files with the
+ * same bytes only rehashes those files.
+ *
+ * The table is kept in `.catalyst.digests`, one `<path>|<inode>|<size>|<mtime_ns>|<digest>`
+ * line per file, and rewritten by `save` when an entry changed.
+ *
+ * As with git's racily clean index entries, a matching stat is only trusted if the file's mtime
+ * is older than the table's own. A file rewritten with the same size within the tick in which it
+ * was hashed would otherwise keep its stale digest. Such entries are rehashed on every lookup
+ * until a later `save` stamps the table after them.
+ */
+class DigestCache {
+public:
+    /**
+     * @brief Loads an existing table. A missing or unreadable table is treated as empty.
+     * @param path The path to the table.
+     */
+    explicit DigestCache(const std::filesystem::path &path);
+
+    /**
+     * @brief The digest of a file's contents, hashing it only if `stat` differs from the recorded one.
+     * Thread-safe.
+     * @param path The file.
+     * @param stat A fresh stat of `path`.
+     * @return The digest, or nothing if the stat failed or the file cannot be read.
+     */
+    std::optional<Digest> digest(std::string_view path, const StatResult &stat);
+
+    /**
+     * @brief Writes the table to a temporary file and renames it over the original.
+     * Does nothing if no entry changed.
+     * @return Success or error.
+     */
+    Result<void> save();
+
+private:
+    struct Entry {
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        Digest digest;
+        bool verified = false; ///< The file's mtime is older than `saved_at_ns_`; not persisted.
+    };
+
+    /** @brief The table file's mtime, or nothing if it cannot be statted. */
+    std::optional<int64_t> table_mtime_ns() const;
+
+    std::filesystem::path path_;
+    std::shared_ptr<MappedFile> file_keep_alive_;
+
+    std::shared_mutex mtx_;
+    std::unordered_map<std::string_view, Entry> entries_;
+    std::deque<std::string> added_paths_; ///< Owns keys of `entries_` first seen in `digest`.
+    int64_t saved_at_ns_ = 0;             ///< The table file's mtime when it was loaded or last saved.
+    bool changed_ = false;
+};
+
+} // namespace catalyst
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <optional>
+#include <cstdint>
+#include <span>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
@@ -22,22 +23,51 @@ struct BuildStep {
     /** @brief The output file path generated by this step. */
     std::string_view output;
     
-    /** 
-     * @brief Inputs that are not explicitly parsed but affect the build.
+    /**
+     * @brief Node ids of every input: the explicit ones, then the opaque ones, then those
+     * discovered from the dependency file. Set by the graph once it is finalized.
+     */
+    std::span<const uint32_t> input_nodes = {};
+
+    /** @brief The explicit inputs parsed from the `inputs` string (a prefix of `input_nodes`). */
+    std::span<const uint32_t> parsed_inputs = {};
+
+    /**
+     * @brief Inputs that are not explicitly parsed but affect the build (`!`-prefixed in the manifest).
      * Often used for order-only dependencies or implicit system dependencies.
      */
-    std::optional<std::vector<std::string_view>> opaque_inputs = std::nullopt;
-    
-    /** 
+    std::span<const uint32_t> opaque_inputs = {};
+
+    /**
      * @brief Inputs discovered dynamically from a dependency file (e.g., .d files from GCC/Clang).
      */
-    std::optional<std::vector<std::string_view>> depfile_inputs = std::nullopt;
-    
-    /** @brief List of explicit input file paths parsed from the `inputs` string. */
-    std::vector<std::string_view> parsed_inputs;
+    std::span<const uint32_t> depfile_inputs = {};
+
+    /** @brief Node id of `output`. Set by the graph when the step is added. */
+    uint32_t output_node = 0;
+
+    /**
+     * @brief The pool the step runs in (optional fourth column of the step line); empty if
+     * none was named. See `Pools`.
+     */
+    std::string_view pool = {};
+
+    /**
+     * @brief Whether the step is checked for an unchanged output after it ran (`restat` in the
+     * optional fifth column). If the output is byte-identical to before, it keeps its old mtime
+     * and the steps that depend on it are not rebuilt for its sake.
+     */
+    bool restat = false;
 };
 
 /** @brief Global definitions/variables for the build (e.g., compiler flags, tool paths). */
 using Definitions = std::unordered_map<std::string_view, std::string_view>;
 
+/**
+ * @brief Resource pools declared with `POOL|<name>|<depth>`: at most `depth` steps of a pool run
+ * at once. A pool named after a tool (e.g. `ld`) also applies to every step of that tool
+ * that does not name a pool itself.
+ */
+using Pools = std::unordered_map<std::string_view, size_t>;
+
 } // namespace catalyst
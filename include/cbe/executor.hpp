@@ -1,59 +1,148 @@
 #pragma once
 
+#include "cbe/artifact_cache.hpp"
+#include "cbe/build_log.hpp"
 #include "cbe/builder.hpp"
+#include "cbe/digest_cache.hpp"
 #include "cbe/graph.hpp"
+#include "cbe/hash.hpp"
+#include "cbe/scheduler.hpp"
+#include "cbe/stat_batch.hpp"
 #include "cbe/utility.hpp"
 #include "cbe/work_estimate.hpp"
 
-#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
-#include <thread>
+#include <string_view>
 #include <vector>
 
 namespace catalyst {
 
 /**
- * @brief Thread-safe cache for file status information (modification times).
+ * @brief Dense table of file modification times, indexed by graph node id.
  *
- * This cache prevents redundant filesystem calls when checking multiple dependencies
- * for the same file across different threads.
+ * Every file in the build already has a node id, so the table is a flat array sized to
+ * the graph. `prefetch` fills it in batches; after that, lookups are a single acquire
+ * load plus an array read, with no lock and no allocation. Slots that were not
+ * prefetched are computed on first use and published with an atomic state flag.
  */
 class StatCache {
-    struct Entry {
-        std::filesystem::path path;
-        std::filesystem::file_time_type time;
-        std::error_code ec;
+public:
+    /**
+     * @param graph The graph whose nodes are tracked. Must outlive the cache.
+     */
+    explicit StatCache(const BuildGraph &graph);
 
-        bool operator<(const Entry &other) const;
-        bool operator<(const std::filesystem::path &other_path) const;
-    };
+    /**
+     * @brief Retrieves the last write time of a node, statting it on first use.
+     * @param node The node id.
+     * @return The last write time and any error code.
+     */
+    StatResult get(uint32_t node);
 
-    std::vector<Entry> cache;
-    std::shared_mutex cache_mtx;
+    /**
+     * @brief Also tracks the content digest of every node, looked up in `digests` (`--hash` mode).
+     * Call before any lookup.
+     * @param digests The persistent digest table. Must outlive the cache.
+     */
+    void enable_digests(DigestCache &digests);
+
+    /**
+     * @brief Retrieves the content digest of a node, computing it on first use. Requires `enable_digests`.
+     * @param node The node id.
+     * @return The digest, or nothing if the node does not exist or cannot be read. It stays the
+     *         same until the node is refreshed, even if the file changes in the meantime.
+     */
+    std::optional<Digest> digest(uint32_t node);
 
-public:
     /**
-     * @brief Retrieves the last write time for a path, caching the result.
-     * @param p The file path to check.
-     * @return A pair containing the last write time and any error code.
+     * @brief Stats the given nodes in one batch (see `stat_batch`) and fills their slots.
+     * @param nodes The node ids; each should appear once.
+     * @param threads Thread count for the non-io_uring fallback (0 = auto).
+     * @return Counters describing the batch.
      */
-    std::pair<std::filesystem::file_time_type, std::error_code> get_or_update(const std::filesystem::path &p);
+    StatBatchReport prefetch(std::span<const uint32_t> nodes, size_t threads = 0);
 
     /**
-     * @brief Checks if an input file has changed since a given output timestamp.
-     * @param input The input file path.
-     * @param output_time The timestamp of the output file.
-     * @return True if input is newer or stat failed, false otherwise.
+     * @brief Computes the digests of the given nodes across threads. Requires `enable_digests`.
+     * @param nodes The node ids; each should appear once, and should have been statted already.
+     * @param threads Upper bound on the threads used (0 = hardware concurrency).
      */
-    bool changed_since(const std::filesystem::path &input, std::filesystem::file_time_type output_time);
+    void prefetch_digests(std::span<const uint32_t> nodes, size_t threads = 0);
+
+    /** @brief Forgets every entry, so each node is statted (and hashed) again on next use. Not thread-safe. */
+    void reset();
+
+    /**
+     * @brief Re-stats a node whose entry is known to be outdated (e.g. a freshly built output).
+     *
+     * Only the thread that produced the node may call this; its dependents read the new
+     * value after the scheduler releases them.
+     *
+     * @param node The node id.
+     */
+    void refresh(uint32_t node);
+
+private:
+    enum class SLOT : uint8_t { EMPTY, COMPUTING, READY };
+
+    const BuildGraph &graph;
+    std::unique_ptr<StatResult[]> results;
+    std::unique_ptr<std::atomic<SLOT>[]> state;
+
+    DigestCache *digests = nullptr;
+    std::unique_ptr<std::optional<Digest>[]> digest_results;
+    std::unique_ptr<std::atomic<SLOT>[]> digest_state;
+};
+
+/** @brief How the executor orders steps that are ready to run. */
+enum class SchedulePolicy : uint8_t {
+    CRITICAL_PATH, ///< Longest estimated path from the step to any sink first.
+    ESTIMATE,      ///< Most expensive step first, ignoring what depends on it.
+};
+
+/** @brief Why a step has to run, as decided by the dirty pass. */
+struct DirtyReason {
+    enum class KIND : uint8_t {
+        CLEAN,           ///< Up to date; the step is not scheduled.
+        MISSING_OUTPUT,  ///< The output does not exist.
+        COMMAND_CHANGED, ///< The command differs from the one in the build log.
+        MISSING_INPUT,   ///< `node` does not exist.
+        NEWER_INPUT,     ///< `node` is not older than the output.
+        CHANGED_CONTENT, ///< In `--hash` mode, the inputs differ from those the output was built from.
+        DIRTY_INPUT,     ///< Up to date itself, but `node` is produced by a dirty step.
+    };
+
+    KIND kind = KIND::CLEAN;
+    uint32_t node = 0; ///< The input responsible, for the `*_INPUT` kinds.
+
+    bool dirty() const {
+        return kind != KIND::CLEAN;
+    }
 };
 
 struct ExecutorConfig {
-    bool dry_run = false;                              ///< If true, print commands without executing.
-    bool clean = false;                                ///< If true, clean artifacts instead of building.
-    size_t jobs = 0;                                   ///< Number of parallel jobs (0 = auto-detect).
-    std::string build_file = "catalyst.build";         ///< Path to the build manifest.
-    std::string estimates_file = "catalyst.estimates"; ///< Path to the work estimates file.
+    bool dry_run = false;                                    ///< If true, print commands without executing.
+    bool clean = false;                                      ///< If true, clean artifacts instead of building.
+    bool explain = false;                                    ///< If true, print why each dirty step runs.
+    size_t jobs = 0;                                         ///< Number of parallel jobs (0 = auto-detect).
+    SchedulePolicy schedule = SchedulePolicy::CRITICAL_PATH; ///< Ready queue ordering.
+    std::string build_file = "catalyst.build";               ///< Path to the build manifest.
+    std::string estimates_file = "catalyst.estimates";       ///< Path to the work estimates file.
+    std::string log_file = ".catalyst.log";                  ///< Path to the per-step build log.
+    std::string rss_file = ".catalyst.rss";                  ///< Path to the learned peak RSS of each step.
+    std::string deps_file = ".catalyst.deps";                ///< Path to the discovered inputs of `cc`/`cxx` steps.
+    size_t memory_budget_mib = 0; ///< Predicted peak RSS of the running steps may not exceed this (0 = no limit).
+    bool jobserver = true; ///< Join the jobserver in `MAKEFLAGS`, or else provide one to the steps.
+    bool hash = false; ///< Decide staleness by the contents of the inputs rather than their mtimes.
+    std::string digests_file = ".catalyst.digests"; ///< Path to the content digests of the files, for `hash`.
+    std::string cache_dir; ///< Artifact cache for `cc`, `cxx` and `ld` outputs (empty = none).
+    size_t cache_size_mib = 5120; ///< Least recently used artifacts are evicted beyond this.
+    std::vector<std::string> targets; ///< Outputs or `dir/` prefixes to build (see `steps_for_targets`); empty = all.
 };
 
 /**
@@ -69,8 +158,9 @@ public:
     /**
      * @brief Executes the build.
      *
-     * Performs a parallel walk of the build graph, executing steps whose
-     * dependencies are ready and which need rebuilding.
+     * Decides up front which steps are dirty (see `compute_dirty`), then runs only
+     * those, in parallel, as their dependencies complete. A build with nothing dirty
+     * returns without starting any workers.
      *
      * @return Success or error.
      */
@@ -94,12 +184,223 @@ public:
      */
     Result<void> emit_graph();
 
+    /**
+     * @brief Builds, then keeps the graph resident and rebuilds whenever an input changes.
+     *
+     * The directories of all source nodes are watched with inotify. When files change,
+     * only the steps consuming them are re-checked, and only those and their dependents
+     * run, so the cost of a round does not depend on the size of the graph.
+     *
+     * @return Once the manifest changed, or a step that ran now lists different depfile
+     *         inputs; the caller should re-parse and watch again with a fresh executor.
+     *         An error if watching is not possible.
+     */
+    Result<void> watch();
+
 private:
-    bool needs_rebuild(const BuildStep &step, StatCache &stat_cache) const;
+    /** @brief The graph and everything derived from it; stays resident across watch rounds. */
+    struct BuildState {
+        /**
+         * @param digests In `--hash` mode, the digest table the stat cache looks content up in.
+         */
+        explicit BuildState(BuildGraph &&graph, DigestCache *digests = nullptr);
+
+        BuildGraph graph;
+        BuildGraph::StepDag step_dag;
+        StatCache stat_cache;
+        std::vector<DirtyReason> dirty; ///< Per step; reset to `CLEAN` once the step ran.
+        std::vector<uint32_t> task_of;  ///< Scratch step-to-task map for `run_dirty`.
+        std::vector<uint32_t> scope;    ///< The steps being built, ascending: all, or what the targets need.
+        std::vector<uint8_t> in_scope;  ///< Per step, whether it is in `scope`.
+
+        std::atomic<bool> depfiles_changed = false; ///< A step that ran now lists different depfile inputs.
+    };
+
+    /**
+     * @brief Narrows `state.scope` to the steps `config.targets` need; a no-op without targets.
+     * @return An error if a target matches no output.
+     */
+    Result<void> select_targets(BuildState &state) const;
+
+    /**
+     * @brief Records the dependencies a compile step just wrote to its `.d` file in the
+     * dependency log, then deletes the `.d` file. Flags `depfiles_changed` if they differ
+     * from the step's inputs in the graph.
+     * @param deps_out If set, receives a copy of the dependencies.
+     * @return Success, or why the dependencies could not be read or recorded. Either way the
+     * build goes on.
+     */
+    Result<void> ingest_depfile(BuildState &state, size_t step_id, std::vector<std::string> *deps_out = nullptr) const;
+
+    /**
+     * @brief Checks a single step against its own output, ignoring the state of other steps.
+     * @param check_depfile_inputs False to skip the inputs read from the step's depfile.
+     * @return The first reason found, or `CLEAN`. Never `DIRTY_INPUT`.
+     */
+    DirtyReason dirty_reason(const BuildGraph &graph,
+                             const BuildStep &step,
+                             StatCache &stat_cache,
+                             bool check_depfile_inputs = true) const;
+
+    /**
+     * @brief The time the step's inputs are compared against: the output's mtime, or for a
+     * `restat` step whose output kept an older mtime, when it was last built (see `BuildLog::built_at`).
+     * Like an mtime, an input stamped at that time or later makes the step stale.
+     */
+    std::filesystem::file_time_type output_time(const BuildStep &step, const StatResult &output_stat) const;
+
+    /**
+     * @brief The `--hash` mode check of a step whose inputs digest was recorded.
+     * @param inputs The inputs to check for existence; the digest always covers all of them.
+     * @param recorded The digest recorded when the output was last built.
+     * @return `MISSING_INPUT` for the first of `inputs` that is missing, `CHANGED_CONTENT` if the
+     *         digest of the step's inputs differs from `recorded`, or else `CLEAN`.
+     */
+    DirtyReason content_reason(const BuildGraph &graph,
+                               const BuildStep &step,
+                               StatCache &stat_cache,
+                               std::span<const uint32_t> inputs,
+                               const Digest &recorded) const;
+
+    /**
+     * @brief Computes the dirty set of `state.scope` before anything runs.
+     *
+     * Every step in scope is first checked on its own (`dirty_reason`), split across threads
+     * for large graphs, then dirtiness is propagated downstream (`propagate_dirty`). Outputs
+     * and explicit inputs are statted up front; depfile inputs only for the steps still clean
+     * after that. In `--hash` mode, the inputs of those steps are then hashed across threads
+     * where their stat changed.
+     *
+     * @param state The build state; `state.dirty` is overwritten for the steps in scope.
+     * @return The ids of all dirty steps.
+     */
+    std::vector<uint32_t> compute_dirty(BuildState &state) const;
+
+    /**
+     * @brief Marks every step in scope downstream of a dirty step as dirty (`DIRTY_INPUT`), so
+     * the dirty set is closed under dependents within the scope. Steps that are dirty on their
+     * own keep their reason.
+     *
+     * @param state The build state.
+     * @param dirty_steps Dirty steps; newly dirtied steps are appended.
+     */
+    void propagate_dirty(BuildState &state, std::vector<uint32_t> &dirty_steps) const;
+
+    /**
+     * @brief Runs the given dirty steps, in parallel, as their dependencies complete.
+     *
+     * Prints `--explain` output first. Returns without starting workers if there is
+     * nothing to run. Steps that ran are reset to `CLEAN`, and compile steps have their
+     * dependencies recorded (`ingest_depfile`). If those no longer match the graph,
+     * `.catalyst.bin` is invalidated.
+     *
+     * @param state The build state.
+     * @param dirty_steps The steps to run; must be closed under dependents within `state.scope`.
+     * @return Success or error.
+     */
+    Result<void> run_dirty(BuildState &state, std::vector<uint32_t> dirty_steps);
+
+    /** @brief The resource limits of a set of tasks, in the form `Scheduler::Resources` refers to. */
+    struct ResourcePlan {
+        std::vector<size_t> capacities;
+        std::vector<uint32_t> offsets;
+        std::vector<Scheduler::Demand> demands;
+
+        Scheduler::Resources view() const {
+            return {.capacities = capacities, .offsets = offsets, .demands = demands};
+        }
+    };
+
+    /**
+     * @brief Works out what each task needs of the memory budget and of its pool.
+     *
+     * With `config.memory_budget_mib` set, a task demands its predicted peak RSS in KiB: the
+     * learned value for its output, or the mean of the known values for the same tool. Steps
+     * that name a declared pool, or whose tool is the name of one, demand one of its slots.
+     *
+     * @param graph The build graph.
+     * @param task_steps The step id of every task.
+     * @return The plan; without pools or a budget it has no resources.
+     */
+    ResourcePlan plan_resources(const BuildGraph &graph, std::span<const uint32_t> task_steps) const;
+
+    /** @brief Writes back the digest table in `--hash` mode, reporting a failure on stderr. */
+    void save_digests() const;
+
+    /** @brief Number of worker threads to use: `config.jobs`, or the hardware concurrency. */
+    size_t thread_count() const;
+
+    /** @brief Fills `stat_cache` with the mtimes of `nodes` in one batch. */
+    void prefetch_stats(StatCache &stat_cache, std::span<const uint32_t> nodes) const;
+
+    /**
+     * @brief Resolves the work estimate of every task into a dense table.
+     *
+     * Steps without an estimate cost the mean of the known ones.
+     *
+     * @param graph The build graph.
+     * @param task_steps The step id of every task.
+     * @return The estimated cost of every task in milliseconds, indexed by task id.
+     */
+    std::vector<size_t> task_costs(const BuildGraph &graph, std::span<const uint32_t> task_steps) const;
+
+    /**
+     * @brief Computes the scheduling priority of every task according to `config.schedule`.
+     *
+     * In critical-path mode a step's priority is the longest weighted path from it to a sink.
+     *
+     * @param dag The dependency view between the tasks being scheduled.
+     * @param step_cost The cost of every task in `dag`, from `task_costs`.
+     * @return The priority of every task, indexed by task id.
+     */
+    std::vector<size_t> compute_priorities(const BuildGraph::StepDag &dag, std::span<const size_t> step_cost) const;
+
+    /**
+     * @brief Invokes `emit` with each argument of the step's fully expanded command line.
+     * @param graph The graph the step belongs to; input ids are resolved against it.
+     * @param step The step to expand.
+     * @param emit Callable accepting a `std::string_view` per argument.
+     * @param rsp_file If set, `ld` inputs are replaced by `@<rsp_file>`.
+     */
+    template <typename F>
+    void for_each_arg(const BuildGraph &graph,
+                      const BuildStep &step,
+                      F &&emit,
+                      std::optional<std::string_view> rsp_file = std::nullopt) const;
+
+    /** @brief Expands the step into an owning argv suitable for `process_exec`. */
+    std::vector<std::string> expand_command(const BuildGraph &graph,
+                                            const BuildStep &step,
+                                            std::optional<std::string_view> rsp_file = std::nullopt) const;
+
+    /**
+     * @brief Hashes the step's expanded command (tool, relevant definitions, inputs, output)
+     * together with its opaque inputs. This is what the build log records.
+     */
+    uint64_t command_hash(const BuildGraph &graph, const BuildStep &step) const;
+
+    /**
+     * @brief The key of the step in the artifact cache: its tool and expanded command, plus the
+     * paths and contents of its explicit and opaque inputs. Depfile inputs are keyed by the
+     * cache itself (see `ArtifactCache`).
+     * @return The key, or nothing if the step is not cached or an input cannot be read.
+     */
+    std::optional<Digest> artifact_key(const BuildGraph &graph, const BuildStep &step) const;
 
     CBEBuilder builder;
     ExecutorConfig config;
     std::unique_ptr<WorkEstimate> estimator;
-    std::vector<std::jthread> pool;
+    std::unique_ptr<WorkEstimate> rss_estimator; ///< Peak RSS in KiB instead of milliseconds.
+    std::unique_ptr<BuildLog> build_log;
+    std::unique_ptr<ArtifactCache> artifact_cache; ///< Null unless `config.cache_dir` is set.
+    std::unique_ptr<DigestCache> digest_cache;     ///< Null unless `config.hash` is set.
+
+    // Definitions pre-split on spaces (empty parts dropped).
+    std::vector<std::string> cc_vec;
+    std::vector<std::string> cxx_vec;
+    std::vector<std::string> cflags_vec;
+    std::vector<std::string> cxxflags_vec;
+    std::vector<std::string> ldflags_vec;
+    std::vector<std::string> ldlibs_vec;
 };
 } // namespace catalyst
@@ -1,31 +1,81 @@
 #pragma once
 
+#include "cbe/arena.hpp"
 #include "cbe/domain.hpp"
 #include "cbe/utility.hpp"
 
+#include <cstdint>
 #include <filesystem>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace catalyst {
 
+class DepsLog;
+
 /**
  * @brief Represents the dependency graph of the build system.
  *
  * This class manages nodes (files) and edges (dependencies), as well as the list of build steps.
  * It also manages the lifetime of resources (like memory-mapped files) used by the graph strings.
+ *
+ * Node paths are copied once into an arena when the node is created, so the files they were
+ * read from (e.g. `.d` files) can be released right away. Every node also records its parent
+ * directory as an id into a table of directories, each of which points at its own parent.
+ *
+ * Edges and step inputs are stored as flat `uint32_t` arrays (compressed sparse row), and
+ * nodes and steps only hold spans into them. Steps added with `add_step` are collected
+ * first and laid out by `finalize`; a graph loaded from `.catalyst.bin` points straight
+ * into the mapped file instead and is read-only.
  */
 class BuildGraph {
 public:
     /** @brief Represents a node in the dependency graph (typically a file). */
     struct Node {
         std::string_view path;
-        std::vector<size_t> out_edges; ///< Indices of nodes that depend on this node.
-        std::optional<size_t> step_id; ///< Index of the BuildStep that produces this node (if any).
+        std::span<const uint32_t> out_edges; ///< Indices of nodes that depend on this node.
+        std::optional<size_t> step_id;       ///< Index of the BuildStep that produces this node (if any).
+        uint32_t dir = 0;                    ///< Index of the directory containing this node.
+    };
+
+    /** @brief A directory containing nodes, spelled as a prefix of their paths ("" is the working directory). */
+    struct Dir {
+        std::string_view path;
+        uint32_t parent; ///< Index of the parent directory, `NO_DIR` for "".
+    };
+
+    static constexpr uint32_t NO_DIR = UINT32_MAX;
+
+    /** @brief Where a step's inputs live in a flat input array, by kind. */
+    struct InputRange {
+        uint32_t begin;
+        uint32_t explicit_end;
+        uint32_t opaque_end;
+        uint32_t end;
+    };
+
+    BuildGraph() = default;
+    BuildGraph(BuildGraph &&) = default;
+    BuildGraph &operator=(BuildGraph &&) = default;
+    // Spans point into this graph's own arrays, so a copy would alias the original.
+    BuildGraph(const BuildGraph &) = delete;
+    BuildGraph &operator=(const BuildGraph &) = delete;
+
+    /**
+     * @brief Step-to-step dependency view in compressed sparse row form.
+     *
+     * Only steps appear; an edge `a -> b` exists for every input of step `b` that is
+     * produced by step `a`. Source files, which have nothing to execute, are omitted.
+     */
+    struct StepDag {
+        std::vector<uint32_t> offsets;    ///< Dependents of step `i` are `successors[offsets[i]..offsets[i+1])`.
+        std::vector<uint32_t> successors; ///< Flattened dependent step ids.
     };
 
     /**
@@ -35,17 +85,96 @@ public:
      */
     size_t get_or_create_node(std::string_view path);
 
+    /**
+     * @brief Looks up the node for a path, exactly as it was spelled in the manifest or depfile.
+     * @param path The file path.
+     * @return The node index, or `std::nullopt` if no node has this path.
+     */
+    std::optional<size_t> find_node(std::string_view path) const;
+
+    /**
+     * @brief Checks whether a step's freshly discovered dependencies differ from the inputs the graph has.
+     *
+     * Used after a step reran: a new `#include` only becomes an edge when the graph is rebuilt.
+     *
+     * @param step_id The step to check.
+     * @param deps The dependencies listed in the step's new `.d` file.
+     * @return True if `deps` names an input the step does not have, or the counts differ.
+     */
+    bool depfile_changed(size_t step_id, std::span<const std::string_view> deps) const;
+
+    /**
+     * @brief The dependency log (`.catalyst.deps` by default) that `cc`/`cxx` steps read their
+     * discovered inputs from. Loaded on first use.
+     */
+    DepsLog &deps_log();
+
+    /**
+     * @brief Sets the path `deps_log` loads from. Has no effect once the log is loaded.
+     */
+    void set_deps_file(std::filesystem::path path) {
+        deps_file_ = std::move(path);
+    }
+
+    const std::filesystem::path &deps_file() const {
+        return deps_file_;
+    }
+
     /**
      * @brief Adds a new build step to the graph.
      *
-     * This method parses the step's inputs, creates necessary nodes and edges,
-     * and handles dependency file parsing if applicable.
+     * This method parses the step's inputs, creates necessary nodes and edges, and adds
+     * the inputs discovered by the last compile: from its `.d` file if one was left
+     * unconsumed, otherwise from the dependency log.
+     *
+     * The step's input spans stay empty, and edges are not visible in `nodes()`, until
+     * `finalize` is called.
      *
      * @param step The build step to add.
      * @return The index of the added step, or an error if a producer for the output already exists.
      */
     Result<size_t> add_step(BuildStep step);
 
+    /**
+     * @brief Steps whose inputs have been split, read from their depfile or the dependency
+     * log, and deduplicated, but not yet given node ids. See `resolve_steps`.
+     */
+    struct StepBatch {
+        std::vector<BuildStep> steps;
+        std::vector<std::string_view> paths; ///< Unique paths, in order of first appearance.
+        std::vector<uint32_t> outputs;       ///< Per step, the index of its output in `paths`.
+        std::vector<uint32_t> inputs;        ///< Indices into `paths`, grouped per step.
+        std::vector<InputRange> ranges;      ///< Per step, where its inputs are in `inputs`.
+        std::vector<StringArena> strings;    ///< Own paths read from `.d` files, one per loading thread.
+    };
+
+    /**
+     * @brief Does the per-step work of `add_step` that does not touch the graph, so it
+     * can run on many threads at once.
+     *
+     * @param steps The steps, in manifest order.
+     * @param deps_log The loaded dependency log; only read.
+     * @param threads At most this many threads read `.d` files; the result does not depend on it.
+     * @return A batch to pass to `add_resolved`.
+     */
+    static StepBatch resolve_steps(std::vector<BuildStep> steps, const DepsLog &deps_log, size_t threads);
+
+    /**
+     * @brief Adds the steps of a batch, in order. Batches merged in manifest order give the
+     * same node ids as adding every step with `add_step`.
+     *
+     * @param batch A batch from `resolve_steps`.
+     * @return Success, or an error at the first step whose output already has a producer;
+     *         the steps before it have been added.
+     */
+    Result<void> add_resolved(StepBatch &&batch);
+
+    /**
+     * @brief Lays out the edges and step inputs collected by `add_step` in CSR form and
+     * points every node and step at them. Cheap to call again if nothing was added.
+     */
+    void finalize();
+
     /**
      * @brief Keeps a resource alive for the lifetime of the graph.
      * @param res A shared pointer to the resource (e.g., MappedFile).
@@ -60,6 +189,9 @@ public:
     const std::vector<BuildStep> &steps() const {
         return steps_;
     }
+    const std::vector<Dir> &dirs() const {
+        return dirs_;
+    }
 
     /**
      * @brief Performs a topological sort of the graph.
@@ -68,14 +200,66 @@ public:
      */
     Result<std::vector<size_t>> topo_sort() const;
 
+    /**
+     * @brief Builds the step-to-step dependency view used for scheduling.
+     * @return The CSR adjacency between steps.
+     */
+    StepDag step_dag() const;
+
+    /**
+     * @brief Checks the whole step view for cycles, whichever steps are dirty or selected.
+     * @param dag The view from `step_dag`.
+     * @return Success, or an error naming the output of a step on a cycle.
+     */
+    Result<void> check_acyclic(const StepDag &dag) const;
+
+    /**
+     * @brief Finds the steps needed to build `targets`: their producers and, transitively,
+     * the producers of every input of those.
+     *
+     * A target is an output path, or a prefix ending in `/` (e.g. `build/net/`) that selects
+     * every output below it. Requires a finalized graph.
+     *
+     * @param targets The requested targets.
+     * @return The step ids in ascending order, or an error naming a target that matches no output.
+     */
+    Result<std::vector<uint32_t>> steps_for_targets(std::span<const std::string> targets) const;
+
     friend Result<void> parse(class CBEBuilder &, const std::filesystem::path &);
     friend Result<void> parse_bin(class CBEBuilder &);
     friend Result<void> emit_bin(class CBEBuilder &);
 
 private:
+
+    static constexpr uint32_t INDEX_EMPTY = UINT32_MAX;
+
+    /** @brief Slot holding `path` in the path index, or the empty slot where it belongs. */
+    size_t index_slot(std::string_view path) const;
+    /** @brief Makes room for one more node, moving the index into `owned_index_` if needed. */
+    void reserve_index_slot();
+    /** @brief Interns a directory (and its ancestors); `dir` must outlive the graph. */
+    uint32_t get_or_create_dir(std::string_view dir);
+
     std::vector<Node> nodes_;
     std::vector<BuildStep> steps_;
-    std::unordered_map<std::string_view, size_t> index_;
+    std::vector<Dir> dirs_;
+    std::unordered_map<std::string_view, uint32_t> dir_index_;
+    StringArena paths_;
+
+    // Open-addressing path index (FNV-1a, linear probing), mapping paths to node ids.
+    // Either `owned_index_` or a section of .catalyst.bin.
+    std::span<const uint32_t> index_;
+    std::vector<uint32_t> owned_index_;
+
+    // Construction state for graphs built with add_step; laid out by finalize().
+    std::vector<std::pair<uint32_t, uint32_t>> edge_list_; ///< (from, to) in insertion order.
+    std::vector<InputRange> input_ranges_;                 ///< Per step.
+    std::vector<uint32_t> step_inputs_;                    ///< Input node ids, grouped per step.
+    std::vector<uint32_t> edges_;                          ///< CSR targets, grouped per source node.
+    bool finalized_ = true;
+
+    std::filesystem::path deps_file_ = ".catalyst.deps";
+    std::shared_ptr<DepsLog> deps_log_;
     std::vector<std::shared_ptr<void>> resources_;
 };
 
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <xxhash.h>
+
+namespace catalyst {
+
+/**
+ * @brief Incremental 64-bit FNV-1a hasher.
+ *
+ * Used for fingerprinting expanded command lines. Arguments are fed one at a
+ * time with a separator in between so that `{"ab", "c"}` and `{"a", "bc"}`
+ * hash differently.
+ */
+class Fnv1a {
+public:
+    static constexpr uint64_t offset_basis = 0xcbf29ce484222325ULL;
+    static constexpr uint64_t prime = 0x100000001b3ULL;
+
+    void update(std::string_view data) {
+        for (unsigned char c : data) {
+            state_ ^= c;
+            state_ *= prime;
+        }
+    }
+
+    /** @brief Feeds `data` followed by a NUL separator. */
+    void update_arg(std::string_view data) {
+        update(data);
+        update(std::string_view("\0", 1));
+    }
+
+    uint64_t digest() const {
+        return state_;
+    }
+
+private:
+    uint64_t state_ = offset_basis;
+};
+
+/** @brief A 128-bit content digest. */
+struct Digest {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const Digest &) const = default;
+
+    /** @brief 32 lowercase hex digits, high half first. */
+    std::string hex() const {
+        return std::format("{:016x}{:016x}", high, low);
+    }
+};
+
+/**
+ * @brief Incremental XXH3-128 hasher for file contents.
+ *
+ * Unlike `Fnv1a`, which only ever sees short command lines, this one is fed whole inputs
+ * (sources, headers, objects), so it uses the vectorized XXH3 and a digest wide enough to
+ * key a content-addressed store.
+ */
+class ContentHasher {
+public:
+    ContentHasher() : state_(XXH3_createState()) {
+        XXH3_128bits_reset(state_.get());
+    }
+
+    void update(std::string_view data) {
+        XXH3_128bits_update(state_.get(), data.data(), data.size());
+    }
+
+    /** @brief Feeds `data` followed by a NUL separator. */
+    void update_arg(std::string_view data) {
+        update(data);
+        update(std::string_view("\0", 1));
+    }
+
+    /**
+     * @brief Feeds the size and contents of a file.
+     * @return False if the file could not be read; the state is then unspecified.
+     */
+    bool update_file(const std::filesystem::path &path);
+
+    Digest digest() const {
+        const XXH128_hash_t hash = XXH3_128bits_digest(state_.get());
+        return {.low = hash.low64, .high = hash.high64};
+    }
+
+private:
+    struct StateDeleter {
+        void operator()(XXH3_state_t *state) const {
+            XXH3_freeState(state);
+        }
+    };
+
+    std::unique_ptr<XXH3_state_t, StateDeleter> state_;
+};
+
+} // namespace catalyst
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cbe/utility.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace catalyst {
+
+/**
+ * @brief A GNU make jobserver: a pipe or fifo holding one byte per job slot.
+ *
+ * Every process sharing a jobserver owns one implicit slot; for each job beyond that it
+ * reads a token byte and writes the same byte back when the job ends. `from_environment`
+ * joins the jobserver of an outer `make` (`--jobserver-auth=fifo:PATH` or `R,W` in
+ * `MAKEFLAGS`); `create` starts one and advertises it in `MAKEFLAGS`, so the tools cbe
+ * runs (e.g. a parallel LTO link) draw on the same budget as cbe itself.
+ *
+ * Tokens still held on destruction are returned. Not available on Windows.
+ */
+class Jobserver {
+public:
+    /**
+     * @brief Joins the jobserver named in `MAKEFLAGS`.
+     * @return The client, or null if there is none or its descriptors are not open.
+     */
+    static std::unique_ptr<Jobserver> from_environment();
+
+    /**
+     * @brief Creates a fifo jobserver with `jobs` slots in total, the caller's implicit one included,
+     * and sets `MAKEFLAGS` for child processes. The previous `MAKEFLAGS` is restored on destruction.
+     * @return The server, or an error if the fifo could not be created.
+     */
+    static Result<std::unique_ptr<Jobserver>> create(size_t jobs);
+
+    ~Jobserver();
+
+    Jobserver(const Jobserver &) = delete;
+    Jobserver &operator=(const Jobserver &) = delete;
+
+    /** @brief A descriptor that polls readable when `try_acquire` may succeed. */
+    int fd() const {
+        return read_fd_;
+    }
+
+    /** @brief Takes a token if one is available, without blocking. Thread-safe. */
+    bool try_acquire();
+
+    /** @brief Waits for a token. Thread-safe. */
+    Result<void> acquire();
+
+    /** @brief Returns a token taken by `try_acquire` or `acquire`. Thread-safe. */
+    void release();
+
+private:
+    Jobserver() = default;
+
+    int read_fd_ = -1;
+    int write_fd_ = -1;
+    bool owns_read_fd_ = false;            ///< Opened by us rather than inherited from make.
+    bool owns_write_fd_ = false;           ///< Opened by us rather than inherited from make.
+    std::filesystem::path fifo_path_;      ///< Set for a server; removed on destruction.
+    bool advertised_ = false;              ///< Whether we set `MAKEFLAGS`.
+    std::optional<std::string> makeflags_; ///< The `MAKEFLAGS` we replaced, if it was set.
+
+    std::mutex tokens_mtx_;
+    std::vector<char> tokens_; ///< Bytes read, written back as they were (make may use them to signal).
+};
+
+} // namespace catalyst
@@ -2,21 +2,68 @@
 
 #include "cbe/utility.hpp"
 
+#include <cstddef>
 #include <future>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
 namespace catalyst {
 /**
- * @brief Executes a subprocess.
+ * @brief Executes a subprocess and waits for it. Its stdout and stderr are inherited.
  *
- * @param args The command line arguments (first argument is the executable).
+ * On Linux the child is started with `posix_spawn` and gets no file descriptors beyond
+ * stdin, stdout and stderr; elsewhere `reproc` is used.
+ *
+ * @param args The command line arguments (first argument is the executable, looked up in `PATH`).
  * @param working_dir Optional working directory for the subprocess.
  * @param env Optional environment variables to extend/override the parent environment.
- * @return The exit code of the process on success, or -1 on error.
+ * @return The exit code of the process (128 + the signal number if it was killed), or an
+ *         error if it could not be started.
  */
 Result<int> process_exec(std::vector<std::string> &&args,
                          std::optional<std::string> working_dir = std::nullopt,
                          std::optional<std::unordered_map<std::string, std::string>> env = std::nullopt);
+
+#ifdef __linux__
+/** @brief A child started by `process_spawn`; reap it with `process_wait`. */
+struct ChildProcess {
+    int pid = -1;
+    int pidfd = -1;          ///< Readable once the child exited; -1 if it could not be opened.
+    size_t peak_rss_kib = 0; ///< Peak RSS of the child and its descendants; set by `process_wait`.
+    int output_fd = -1;      ///< The file the child's stdout and stderr go to, if captured.
+    std::string output{};    ///< Everything the child wrote, if captured; set by `process_wait`.
+};
+
+/**
+ * @brief Leaves descriptors 3 to `fd` open in every child spawned from now on; by default
+ * only stdin, stdout and stderr are. Used to pass on an inherited jobserver pipe.
+ */
+void process_inherit_fds_through(int fd);
+
+/** @brief Whether the kernel supports pidfds (Linux 5.3 and later). */
+bool pidfd_supported();
+
+/**
+ * @brief Starts a subprocess like `process_exec`, but returns without waiting for it.
+ *
+ * The child's pidfd lets an event loop (e.g. epoll) learn when it exits.
+ *
+ * @param capture_output Send the child's stdout and stderr to an anonymous file instead of
+ *        ours, and read it back in `process_wait`. A file rather than a pipe: the child never
+ *        blocks on a full pipe, so nothing has to drain it while it runs.
+ */
+Result<ChildProcess> process_spawn(std::vector<std::string> &&args,
+                                   std::optional<std::string> working_dir = std::nullopt,
+                                   std::optional<std::unordered_map<std::string, std::string>> env = std::nullopt,
+                                   bool capture_output = false);
+
+/**
+ * @brief Waits for a child from `process_spawn`, records its peak RSS and captured output,
+ * and closes its descriptors.
+ * @return As `process_exec`.
+ */
+Result<int> process_wait(ChildProcess &child);
+#endif
 } // namespace catalyst
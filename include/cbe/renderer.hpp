@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace catalyst {
+
+/**
+ * @brief Prints build progress from a dedicated thread.
+ *
+ * Producers (the scheduler's workers or the reactor) only push an event onto a lock-free
+ * stack; they never touch a stream or take a lock. The renderer thread takes the whole
+ * stack at once every few milliseconds and writes everything it contains with a single
+ * `fwrite`, so output costs one syscall per batch rather than several per step.
+ *
+ * In `LINES` mode every started or skipped step gets its own `[n/N] tool -> output` line. In `STATUS`
+ * mode, used when stdout is a terminal, one line is rewritten in place with the number of
+ * finished and running steps, an ETA and the most recently started step. Messages are
+ * printed above the status line.
+ */
+class Renderer {
+public:
+    enum class Mode : uint8_t {
+        LINES,  ///< One line per started step.
+        STATUS, ///< A single status line rewritten in place.
+    };
+
+    /**
+     * @brief `STATUS` if stdout is a terminal (and `TERM` is not `dumb`), `LINES` otherwise.
+     */
+    static Mode detect_mode();
+
+    /**
+     * @brief Starts the renderer thread.
+     * @param mode How progress is shown.
+     * @param total_steps The number of steps that will be started or skipped.
+     * @param total_cost The summed work estimate of those steps, in milliseconds.
+     * @param dry_run Label started steps as `[DRY RUN]` instead of numbering them.
+     */
+    Renderer(Mode mode, size_t total_steps, size_t total_cost, bool dry_run = false);
+
+    /** @brief Prints everything still queued and stops the thread. */
+    ~Renderer();
+
+    Renderer(const Renderer &) = delete;
+    Renderer &operator=(const Renderer &) = delete;
+
+    /**
+     * @brief Reports that a step started. Thread-safe and lock-free.
+     *
+     * The strings are not copied; they must outlive the renderer.
+     */
+    void started(std::string_view tool, std::string_view output);
+
+    /**
+     * @brief Reports that a step finished. Thread-safe and lock-free.
+     * @param cost The step's work estimate, in milliseconds; advances the ETA.
+     * @param ok Whether the step succeeded.
+     */
+    void finished(size_t cost, bool ok = true);
+
+    /**
+     * @brief Reports that a step counted in `total_steps` will not run after all, e.g. because
+     * its rebuilt inputs came out unchanged. Counts as started and finished. Thread-safe and
+     * lock-free.
+     *
+     * The strings are not copied; they must outlive the renderer.
+     * @param cost The step's work estimate, in milliseconds; advances the ETA.
+     */
+    void skipped(std::string_view tool, std::string_view output, size_t cost);
+
+    /**
+     * @brief Prints a line, in order with the progress output. Thread-safe and lock-free.
+     * @param text The line, without a trailing newline.
+     * @param error Print to stderr instead of stdout.
+     */
+    void message(std::string text, bool error = false);
+
+    /** @brief Prints everything queued so far and stops the thread. Idempotent. */
+    void stop();
+
+private:
+    enum class Kind : uint8_t {
+        STARTED,
+        FINISHED,
+        SKIPPED,
+        MESSAGE,
+        ERROR,
+    };
+
+    struct Event {
+        Event *next = nullptr;
+        Kind kind{};
+        size_t cost = 0;
+        bool ok = true;
+        std::string_view tool{};
+        std::string_view output{};
+        std::string text{};
+    };
+
+    void push(Event *event);
+    void render_loop();
+    void drain();
+    void append_status(std::string &out) const;
+
+    Mode mode_;
+    size_t total_steps_;
+    size_t total_cost_;
+    bool dry_run_;
+    std::chrono::steady_clock::time_point begin_;
+
+    /// Pushed in LIFO order by producers, taken all at once by the renderer thread.
+    std::atomic<Event *> head_ = nullptr;
+
+    // Only touched by the renderer thread.
+    size_t launched_ = 0;
+    size_t finished_ = 0;
+    size_t finished_cost_ = 0;
+    bool failed_ = false;
+    std::string_view last_tool_;
+    std::string_view last_output_;
+    size_t width_ = 0;
+    bool status_shown_ = false;
+
+    std::mutex stop_mtx_; ///< Only guards the wakeup on stop; producers never take it.
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+} // namespace catalyst
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace catalyst {
+
+/**
+ * @brief Delimiter-scanning kernels shared by the manifest and depfile parsers.
+ *
+ * Each kernel has an AVX2 version (32 bytes per step), an SSE2 version (16 bytes per
+ * step) and a scalar fallback. The best one the CPU supports is picked once, on first use.
+ * Single-byte searches are left to `memchr` (`std::string_view::find`), which the C
+ * library already vectorizes and dispatches the same way.
+ */
+
+/**
+ * @brief Finds the first `|` or newline in `text` at or after `pos`.
+ * @return Its index, or `text.size()` if there is none.
+ */
+size_t find_pipe_or_newline(std::string_view text, size_t pos = 0);
+
+/**
+ * @brief Finds the first byte at or after `pos` that ends a depfile token: whitespace
+ * or control characters (anything up to and including ' '), or a backslash.
+ * @return Its index, or `text.size()` if there is none.
+ */
+size_t find_depfile_break(std::string_view text, size_t pos = 0);
+
+/** @brief The kernel set in use: "avx2", "sse2" or "scalar". */
+std::string_view scan_kernel_name();
+
+} // namespace catalyst
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "cbe/utility.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace catalyst {
+
+class Jobserver;
+
+/**
+ * @brief Work-stealing scheduler for a DAG of tasks.
+ *
+ * Every worker owns a small priority queue. A worker pops the highest-priority task
+ * from its own queue, pushes tasks made ready by a completion back onto its own queue,
+ * and steals the highest-priority task of another worker when it runs dry. In-degrees
+ * are decremented atomically, so no global lock is taken on completion. Idle workers
+ * park on an atomic epoch counter and are woken when new work is published.
+ *
+ * Priorities are therefore honored per queue rather than globally, which is close
+ * enough for build scheduling while avoiding a single contended queue.
+ *
+ * Tasks may additionally draw on limited resources (a pool's job slots, memory). A task is
+ * admitted when it is dequeued; if one of its resources cannot cover it, it waits on that
+ * resource, in priority order, until a task holding the resource completes. A resource
+ * nothing holds always admits, so a single task larger than the capacity still runs.
+ */
+class Scheduler {
+public:
+    /** @brief A DAG in compressed sparse row form. */
+    struct Dag {
+        std::span<const uint32_t> offsets;    ///< Successors of task `i` are `successors[offsets[i]..offsets[i+1])`.
+        std::span<const uint32_t> successors; ///< Flattened successor lists.
+        std::span<const size_t> priorities;   ///< Per-task priority; higher runs first.
+    };
+
+    /** @brief An amount of one resource that a task holds while it runs. */
+    struct Demand {
+        uint32_t resource; ///< Index into `Resources::capacities`.
+        size_t amount;
+    };
+
+    /** @brief Limited resources and what each task needs of them. Empty: no limits. */
+    struct Resources {
+        std::span<const size_t> capacities; ///< Units available of each resource.
+        std::span<const uint32_t> offsets;  ///< Demands of task `i` are `demands[offsets[i]..offsets[i+1])`.
+        std::span<const Demand> demands;    ///< Flattened demand lists, each sorted by resource.
+    };
+
+    /**
+     * @brief The work to do for one task.
+     * @return `true` on success. On `false`, no further tasks are started.
+     */
+    using TaskFn = std::function<bool(uint32_t task)>;
+
+    /**
+     * @param dag The task graph. Must outlive the scheduler.
+     * @param num_workers The number of worker threads `run` spawns (at least 1).
+     * @param resources Resource limits; must outlive the scheduler.
+     */
+    Scheduler(const Dag &dag, size_t num_workers, const Resources &resources = {});
+    ~Scheduler();
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    /**
+     * @brief Runs every task exactly once, respecting dependencies.
+     *
+     * Returns once all tasks completed, a task failed, or the remaining tasks can
+     * never become ready (a cycle).
+     *
+     * @param task_fn Invoked concurrently from the worker threads.
+     * @return Success, or an error describing the failure or stall.
+     */
+    Result<void> run(const TaskFn &task_fn);
+
+#ifdef __linux__
+    /** @brief How `StartFn` started a task. */
+    struct Started {
+        bool ok = true; ///< False if the task failed to start; no further tasks are started.
+        int fd = -1;    ///< Readable once the task finished; -1 if it already finished.
+    };
+
+    /** @brief Starts a task without waiting for it to finish. */
+    using StartFn = std::function<Started(uint32_t task)>;
+
+    /**
+     * @brief Called once the fd returned for a task is readable; must close it.
+     * @return `true` on success. On `false`, no further tasks are started.
+     */
+    using FinishFn = std::function<bool(uint32_t task)>;
+
+    /**
+     * @brief Like `run`, but everything happens on the calling thread: up to `max_running`
+     * tasks are started, and epoll reports which of them finished. The number of running
+     * tasks is therefore independent of the number of threads.
+     *
+     * Ready tasks are taken in the same priority order as `run`. After a failure, the tasks
+     * still running are waited for, but nothing new is started.
+     *
+     * With a jobserver, the first running task uses the process's implicit slot and every
+     * further one a token; its fd is watched alongside the tasks while a token is missing.
+     * Tokens are kept for the next ready task and handed back once nothing needs them.
+     *
+     * @return Success, or an error describing the failure or stall.
+     */
+    Result<void> run_reactor(size_t max_running,
+                             const StartFn &start_fn,
+                             const FinishFn &finish_fn,
+                             Jobserver *jobserver = nullptr);
+#endif
+
+    /** @brief Number of tasks completed so far. */
+    size_t completed() const {
+        return completed_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Total number of tasks in the DAG. */
+    size_t total() const {
+        return num_tasks_;
+    }
+
+private:
+    struct Entry {
+        size_t priority;
+        uint32_t task;
+        bool operator<(const Entry &other) const {
+            return priority < other.priority;
+        }
+    };
+
+    struct alignas(64) WorkerQueue {
+        std::mutex mtx;
+        std::vector<Entry> heap;
+        std::atomic<size_t> size = 0; ///< Lets thieves skip empty queues without locking.
+    };
+
+    struct ResourceState {
+        std::mutex mtx;
+        size_t used = 0;
+        std::vector<Entry> waiting; ///< Heap of tasks that did not fit.
+    };
+
+    std::span<const Demand> demands_of(uint32_t task) const;
+    bool admit(uint32_t task);
+    size_t release(size_t worker, uint32_t task);
+    void push(size_t worker, uint32_t task);
+    std::optional<uint32_t> pop_local(size_t worker);
+    std::optional<uint32_t> steal(size_t thief);
+    std::optional<uint32_t> find_task(size_t worker);
+    void complete(size_t worker, uint32_t task);
+    void wake_all();
+    void worker_loop(size_t worker, const TaskFn &task_fn);
+
+    Dag dag_;
+    size_t num_tasks_;
+    size_t num_workers_;
+    std::unique_ptr<std::atomic<uint32_t>[]> in_degrees_;
+    std::unique_ptr<WorkerQueue[]> queues_;
+    Resources resources_;
+    std::unique_ptr<ResourceState[]> resource_states_;
+
+    std::atomic<size_t> completed_ = 0;
+    std::atomic<size_t> in_flight_ = 0; ///< Tasks queued or running.
+    std::atomic<bool> failed_ = false;
+    std::atomic<bool> stalled_ = false;
+    std::atomic<bool> done_ = false;
+
+    std::atomic<uint32_t> wake_epoch_ = 0;
+    std::atomic<size_t> parked_ = 0;
+};
+
+} // namespace catalyst
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace catalyst {
+
+/** @brief The outcome of statting one path; `time` and `ec` mirror `std::filesystem::last_write_time`. */
+struct StatResult {
+    std::filesystem::file_time_type time;
+    std::error_code ec;
+    uint64_t size = 0;  ///< In bytes. Linux only; 0 elsewhere.
+    uint64_t inode = 0; ///< Linux only; 0 elsewhere.
+};
+
+/** @brief Counters describing how a batch was statted. */
+struct StatBatchReport {
+    size_t paths = 0;      ///< Number of paths statted.
+    size_t syscalls = 0;   ///< Number of syscalls issued (setup and teardown excluded).
+    bool io_uring = false; ///< True if the batch went through io_uring.
+};
+
+/**
+ * @brief Stats many paths at once.
+ *
+ * On Linux the paths are submitted to an io_uring as `IORING_OP_STATX` requests in
+ * large batches, so thousands of stats cost a handful of `io_uring_enter` calls and
+ * run in parallel inside the kernel. If io_uring is unavailable (old kernel, seccomp),
+ * the paths are split across `threads` threads that call `statx` directly.
+ *
+ * @param paths The paths to stat.
+ * @param threads Number of threads for the fallback path (0 = hardware concurrency).
+ * @param report Optional out-parameter receiving counters about the batch.
+ * @return One result per path, in the same order.
+ */
+std::vector<StatResult> stat_batch(std::span<const std::string_view> paths,
+                                   size_t threads = 0,
+                                   StatBatchReport *report = nullptr);
+
+/** @brief Stats a single path, filling the same fields as `stat_batch`. */
+StatResult stat_one(std::string_view path);
+
+} // namespace catalyst
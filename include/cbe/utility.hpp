@@ -1,7 +1,18 @@
 #pragma once
 #include <expected>
 #include <string>
+#include <string_view>
 
 namespace catalyst {
 template <typename T> using Result = std::expected<T, std::string>;
+
+/** @brief The directory part of a path ("" for the working directory, "/" for the root). */
+inline std::string_view parent_dir(std::string_view path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string_view::npos)
+        return {};
+    if (slash == 0)
+        return path.size() == 1 ? std::string_view{} : path.substr(0, 1);
+    return path.substr(0, slash);
+}
 }
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "cbe/mmap.hpp"
+#include "cbe/utility.hpp"
 
 #include <charconv>
 #include <cstddef>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 
@@ -28,8 +31,33 @@ public:
         return 0;
     }
 
+    /**
+     * @brief Folds a measured step duration into the estimate for `path`. Thread-safe.
+     *
+     * The new estimate is an exponential moving average of the previous estimate
+     * and the measurement, so one noisy run does not swing the schedule.
+     *
+     * @param path The output path of the step.
+     * @param measured_ms The measured wall time in milliseconds.
+     */
+    void record(std::string_view path, size_t measured_ms);
+
+    /**
+     * @brief Writes all estimates (learned and previously loaded) back to the estimates file.
+     *
+     * The file is written to a temporary path and atomically renamed over the original.
+     * Does nothing if nothing was recorded.
+     *
+     * @return Success or error.
+     */
+    Result<void> save();
+
 private:
+    std::filesystem::path estimates_path;
     std::shared_ptr<MappedFile> estimates_file_keep_alive;
     std::unordered_map<std::string_view, std::string_view> estimates;
+
+    std::mutex learned_mtx;
+    std::unordered_map<std::string, size_t> learned;
 };
 }; // namespace catalyst
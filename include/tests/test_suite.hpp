@@ -2,3 +2,10 @@
 
 bool integration_test();
 bool opaque_deps_test();
+bool scheduler_stress_test();
+bool deps_log_test();
+bool early_cutoff_test();
+bool artifact_cache_test();
+bool digest_cache_test();
+bool scan_test();
+bool process_capture_test();
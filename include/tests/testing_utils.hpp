@@ -1,3 +1,16 @@
+#pragma once
+#include <filesystem>
+#include <functional>
 #include <string>
+#include <string_view>
 
 void create_dummy_file(const std::string &name);
+
+/** @brief Replaces the contents of `path` with `content`, byte for byte. */
+void write_file(const std::filesystem::path &path, std::string_view content);
+
+/**
+ * @brief Runs `fn` inside a fresh directory `name`, which is removed afterwards.
+ * @return What `fn` returned.
+ */
+bool with_scratch_dir(const std::filesystem::path &name, const std::function<bool()> &fn);
@@ -0,0 +1,276 @@
+#include "cbe/artifact_cache.hpp"
+
+#include "cbe/depfile.hpp"
+#include "cbe/hash.hpp"
+#include "cbe/mmap.hpp"
+#include "cbe/utility.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <zstd.h>
+
+namespace catalyst {
+
+namespace {
+
+constexpr std::string_view manifest_signature = "# catalyst manifest v1\n";
+constexpr std::string_view object_magic = "cbeobj01";
+
+// Fast enough to keep up with a compiler; objects still shrink to about a third.
+constexpr int TUNABLE__zstd_level = 3;
+// Trimming goes a little below the budget so that the next few stores do not trim again.
+constexpr uint64_t TUNABLE__trim_target_percent = 90;
+
+/** @brief Fixed-size prefix of an object, followed by the output's zstd frame and then the depfile's, if any. */
+struct ObjectHeader {
+    char magic[8];
+    uint32_t perms;       ///< The output's permission bits, so a linked binary stays executable.
+    uint32_t has_depfile; ///< 1 if a second frame holds the depfile.
+};
+
+Result<void> append_frame(std::string &out, std::string_view data) {
+    const size_t offset = out.size();
+    out.resize(offset + ZSTD_compressBound(data.size()));
+    const size_t written =
+        ZSTD_compress(out.data() + offset, out.size() - offset, data.data(), data.size(), TUNABLE__zstd_level);
+    if (ZSTD_isError(written)) {
+        out.resize(offset);
+        return std::unexpected(std::format("Failed to compress: {}", ZSTD_getErrorName(written)));
+    }
+    out.resize(offset + written);
+    return {};
+}
+
+/** @brief Decompresses the frame at the start of `in` and advances past it. */
+std::optional<std::string> take_frame(std::string_view &in) {
+    const size_t frame_size = ZSTD_findFrameCompressedSize(in.data(), in.size());
+    const unsigned long long content_size = ZSTD_getFrameContentSize(in.data(), in.size());
+    if (ZSTD_isError(frame_size) || content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+        return std::nullopt;
+    std::string out(content_size, '\0');
+    const size_t written = ZSTD_decompress(out.data(), out.size(), in.data(), frame_size);
+    if (ZSTD_isError(written) || written != out.size())
+        return std::nullopt;
+    in.remove_prefix(frame_size);
+    return out;
+}
+
+/** @brief Marks `path` as just used, for `trim`. */
+void touch(const std::filesystem::path &path) {
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+}
+
+} // namespace
+
+ArtifactCache::ArtifactCache(std::filesystem::path dir, uint64_t max_bytes)
+    : dir_(std::move(dir)), max_bytes_(max_bytes), tmp_tag_(std::random_device{}()) {}
+
+std::filesystem::path ArtifactCache::manifest_path(const Digest &key) const {
+    const std::string hex = key.hex();
+    return dir_ / "manifests" / hex.substr(0, 2) / hex.substr(2);
+}
+
+std::filesystem::path ArtifactCache::object_path(const Digest &key) const {
+    const std::string hex = key.hex();
+    return dir_ / "objects" / hex.substr(0, 2) / hex.substr(2);
+}
+
+std::optional<Digest> ArtifactCache::object_key(const Digest &key, const std::vector<std::string> &deps) {
+    ContentHasher hasher;
+    hasher.update_arg(key.hex());
+    for (const auto &dep : deps) {
+        hasher.update_arg(dep);
+        if (!hasher.update_file(dep))
+            return std::nullopt;
+    }
+    return hasher.digest();
+}
+
+Result<void> ArtifactCache::write_atomically(const std::filesystem::path &path,
+                                             std::string_view content,
+                                             std::optional<std::filesystem::perms> perms) const {
+    auto tmp_path = path;
+    tmp_path += std::format(".{:x}-{}.tmp", tmp_tag_, tmp_counter_.fetch_add(1));
+    {
+        std::ofstream tmp(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!tmp)
+            return std::unexpected(std::format("Failed to open {} for writing", tmp_path.string()));
+        tmp.write(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!tmp.flush()) {
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return std::unexpected(std::format("Failed to write {}", tmp_path.string()));
+        }
+    }
+    std::error_code ec;
+    if (perms)
+        std::filesystem::permissions(tmp_path, *perms, ec);
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+        return std::unexpected(std::format("Failed to rename {} to {}", tmp_path.string(), path.string()));
+    }
+    return {};
+}
+
+bool ArtifactCache::restore(const Digest &key,
+                            const std::filesystem::path &output,
+                            const std::optional<std::filesystem::path> &depfile) {
+    auto restored = [&] {
+        std::vector<std::string> deps;
+        const std::filesystem::path manifest = manifest_path(key);
+        try {
+            MappedFile map(manifest);
+            std::string_view content = map.content();
+            if (!content.starts_with(manifest_signature))
+                return false;
+            content.remove_prefix(manifest_signature.size());
+            for (size_t end; (end = content.find('\n')) != std::string_view::npos; content.remove_prefix(end + 1))
+                deps.emplace_back(content.substr(0, end));
+        } catch (const std::runtime_error &) {
+            return false;
+        }
+
+        auto object_digest = object_key(key, deps);
+        if (!object_digest)
+            return false;
+        const std::filesystem::path object = object_path(*object_digest);
+        std::optional<std::string> output_content;
+        std::optional<std::string> depfile_content;
+        ObjectHeader header{};
+        try {
+            MappedFile map(object);
+            std::string_view content = map.content();
+            if (content.size() < sizeof(header))
+                return false;
+            std::memcpy(&header, content.data(), sizeof(header));
+            content.remove_prefix(sizeof(header));
+            if (std::string_view(header.magic, sizeof(header.magic)) != object_magic ||
+                (header.has_depfile != 0) != depfile.has_value())
+                return false;
+            output_content = take_frame(content);
+            if (depfile)
+                depfile_content = take_frame(content);
+        } catch (const std::runtime_error &) {
+            return false;
+        }
+        if (!output_content || (depfile && !depfile_content))
+            return false;
+
+        // The depfile goes first: an output without it would look up to date with no dependencies.
+        if (depfile && !write_atomically(*depfile, *depfile_content))
+            return false;
+        if (!write_atomically(output, *output_content, static_cast<std::filesystem::perms>(header.perms)))
+            return false;
+        touch(manifest);
+        touch(object);
+        return true;
+    }();
+    (restored ? hits_ : misses_).fetch_add(1);
+    return restored;
+}
+
+Result<void> ArtifactCache::store(const Digest &key,
+                                  const std::filesystem::path &output,
+                                  const std::optional<std::filesystem::path> &depfile) {
+    std::string depfile_content;
+    std::vector<std::string> deps;
+    if (depfile) {
+        try {
+            MappedFile map(*depfile);
+            depfile_content = map.content();
+        } catch (const std::runtime_error &) {
+            return std::unexpected(std::format("Failed to read {}", depfile->string()));
+        }
+        parseDepfileContent(depfile_content, [&deps](std::string_view dep) { deps.emplace_back(dep); });
+    }
+    auto object_digest = object_key(key, deps);
+    if (!object_digest)
+        return std::unexpected(std::format("A dependency of {} could not be read", output.string()));
+
+    ObjectHeader header{};
+    std::memcpy(header.magic, object_magic.data(), sizeof(header.magic));
+    std::error_code ec;
+    header.perms = static_cast<uint32_t>(std::filesystem::status(output, ec).permissions());
+    header.has_depfile = depfile ? 1 : 0;
+    std::string object(reinterpret_cast<const char *>(&header), sizeof(header));
+    Result<void> compressed;
+    try {
+        MappedFile map(output);
+        compressed = append_frame(object, map.content());
+    } catch (const std::runtime_error &) {
+        return std::unexpected(std::format("Failed to read {}", output.string()));
+    }
+    if (compressed && depfile)
+        compressed = append_frame(object, depfile_content);
+    if (!compressed)
+        return compressed;
+
+    std::string manifest(manifest_signature);
+    for (const auto &dep : deps)
+        manifest += std::format("{}\n", dep);
+
+    // The object goes first, so a manifest never names deps for which nothing is stored.
+    const std::filesystem::path object_file = object_path(*object_digest);
+    const std::filesystem::path manifest_file = manifest_path(key);
+    std::filesystem::create_directories(object_file.parent_path(), ec);
+    std::filesystem::create_directories(manifest_file.parent_path(), ec);
+    if (auto res = write_atomically(object_file, object); !res)
+        return res;
+    if (auto res = write_atomically(manifest_file, manifest); !res)
+        return res;
+    stored_.fetch_add(1);
+    return {};
+}
+
+void ArtifactCache::trim() {
+    if (stored_.load() == 0)
+        return;
+
+    struct File {
+        std::filesystem::file_time_type used;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+    std::vector<File> files;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir_, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+        std::error_code file_ec;
+        if (!it->is_regular_file(file_ec))
+            continue;
+        const uint64_t size = it->file_size(file_ec);
+        const auto used = it->last_write_time(file_ec);
+        if (file_ec)
+            continue;
+        files.push_back({.used = used, .size = size, .path = it->path()});
+        total += size;
+    }
+    if (total <= max_bytes_)
+        return;
+
+    std::ranges::sort(files, {}, &File::used);
+    const uint64_t target = max_bytes_ / 100 * TUNABLE__trim_target_percent;
+    for (const auto &file : files) {
+        if (total <= target)
+            break;
+        if (std::filesystem::remove(file.path, ec))
+            total -= file.size;
+    }
+}
+
+} // namespace catalyst
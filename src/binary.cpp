@@ -2,14 +2,21 @@
 
 #include "cbe/builder.hpp"
 #include "cbe/graph.hpp"
+#include "cbe/hash.hpp"
 #include "cbe/mmap.hpp"
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <fcntl.h>
+#include <filesystem>
+#include <format>
 #include <fstream>
 #include <memory>
+#include <span>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
@@ -19,21 +26,20 @@ namespace catalyst {
 
 namespace {
 
-struct StringRef {
-    uint64_t offset;
-    uint64_t len;
+// Every section is a flat array of 4-byte fields, so the mapped file can be used in place.
+struct BinString {
+    uint32_t offset;
+    uint32_t len;
 };
 
 class StringBuffer {
 public:
-    StringRef add(std::string_view sv) {
+    BinString add(std::string_view sv) {
         if (auto it = cache_.find(sv); it != cache_.end()) {
             return it->second;
         }
-        uint64_t offset = data_.size();
-        uint64_t len = sv.size();
+        BinString ref = {.offset = static_cast<uint32_t>(data_.size()), .len = static_cast<uint32_t>(sv.size())};
         data_.append(sv);
-        StringRef ref = {.offset=offset, .len=len};
         cache_[sv] = ref;
         return ref;
     }
@@ -44,24 +50,108 @@ public:
 
 private:
     std::string data_;
-    std::unordered_map<std::string_view, StringRef> cache_;
+    std::unordered_map<std::string_view, BinString> cache_;
 };
 
- constexpr size_t bin_header_magic_bit_len = 8;
+constexpr size_t bin_header_magic_bit_len = 8;
 
+#if defined(__linux__)
+constexpr std::string_view bin_magic = "CATBL005";
+#elif defined(__APPLE__)
+constexpr std::string_view bin_magic = "CATBM005";
+#else
+constexpr std::string_view bin_magic = "CATBW005";
+#endif
+
+/**
+ * @brief File header. The sections follow in this order: definitions, pools, directories,
+ * nodes, edge offsets (`num_nodes + 1`), edges, steps, step inputs, path index, strings.
+ */
 struct BinHeader {
     std::array<char, bin_header_magic_bit_len> magic;
-    uint64_t num_definitions;
-    uint64_t num_nodes;
-    uint64_t num_steps;
+    uint32_t num_definitions;
+    uint32_t num_dirs;
+    uint32_t num_nodes;
+    uint32_t num_steps;
+    uint32_t num_edges;
+    uint32_t num_step_inputs;
+    uint32_t num_index_slots;
+    uint32_t num_pools;
     uint64_t strings_size;
+    uint64_t checksum; ///< FNV-1a of every header byte before this field.
 };
 
 struct BinDefinition {
-    StringRef key;
-    StringRef val;
+    BinString key;
+    BinString val;
+};
+
+struct BinPool {
+    BinString name;
+    uint32_t depth;
+};
+
+struct BinDir {
+    BinString path;
+    uint32_t parent; ///< UINT32_MAX for the working directory.
+};
+
+struct BinNode {
+    BinString path;
+    uint32_t step_id; ///< UINT32_MAX for source files.
+    uint32_t dir;
 };
 
+/** @brief A step; its inputs are `step_inputs[begin..end)`, split like `BuildGraph::InputRange`. */
+struct BinStep {
+    BinString tool;
+    BinString inputs;
+    BinString pool;
+    uint32_t flags; ///< `bin_step_restat`.
+    uint32_t output_node;
+    uint32_t begin;
+    uint32_t explicit_end;
+    uint32_t opaque_end;
+    uint32_t end;
+};
+
+constexpr uint32_t bin_no_step = UINT32_MAX;
+constexpr uint32_t bin_step_restat = 1;
+
+uint64_t header_checksum(const BinHeader &header) {
+    Fnv1a hasher;
+    hasher.update({reinterpret_cast<const char *>(&header), offsetof(BinHeader, checksum)});
+    return hasher.digest();
+}
+
+uint64_t expected_size(const BinHeader &h) {
+    return sizeof(BinHeader) + (uint64_t{h.num_definitions} * sizeof(BinDefinition)) +
+           (uint64_t{h.num_pools} * sizeof(BinPool)) + (uint64_t{h.num_dirs} * sizeof(BinDir)) +
+           (uint64_t{h.num_nodes} * sizeof(BinNode)) + ((uint64_t{h.num_nodes} + 1) * sizeof(uint32_t)) +
+           (uint64_t{h.num_edges} * sizeof(uint32_t)) + (uint64_t{h.num_steps} * sizeof(BinStep)) +
+           (uint64_t{h.num_step_inputs} * sizeof(uint32_t)) + (uint64_t{h.num_index_slots} * sizeof(uint32_t)) +
+           h.strings_size;
+}
+
+/** @brief Hands out consecutive, correctly typed sections of the mapped file. */
+class SectionReader {
+public:
+    explicit SectionReader(const char *ptr) : ptr_(ptr) {}
+
+    template <typename T> std::span<const T> take(size_t count) {
+        std::span<const T> section(reinterpret_cast<const T *>(ptr_), count);
+        ptr_ += count * sizeof(T);
+        return section;
+    }
+
+private:
+    const char *ptr_;
+};
+
+template <typename T> void write_section(std::ofstream &out, std::span<const T> section) {
+    out.write(reinterpret_cast<const char *>(section.data()), static_cast<std::streamsize>(section.size_bytes()));
+}
+
 } // namespace
 
 Result<void> parse_bin(CBEBuilder &builder) {
@@ -77,204 +167,242 @@ Result<void> parse_bin(CBEBuilder &builder) {
         return std::unexpected("Malformed .catalyst.bin: too small for header");
     }
 
-    const auto *header = reinterpret_cast<const BinHeader *>(content.data());
-#ifdef __linux__
-    if (std::memcmp(header->magic.data(), "CATBL001", bin_header_magic_bit_len) != 0) {
-#elifdef __apple__
-    if (std::memcmp(header->magic, "CATBM001", 8) != 0) {
-#elifdef _WIN32 || _WIN64
-    if (std::memcmp(header->magic, "CATBW001", 8) != 0) {
-#endif
+    BinHeader header;
+    std::memcpy(&header, content.data(), sizeof(BinHeader));
+    if (std::string_view(header.magic.data(), bin_header_magic_bit_len) != bin_magic) {
         return std::unexpected("Invalid magic or version in .catalyst.bin");
     }
-
-    if (header->strings_size > content.size() - sizeof(BinHeader)) {
-        return std::unexpected("Malformed .catalyst.bin: strings_size too large");
+    if (header.checksum != header_checksum(header)) {
+        return std::unexpected("Malformed .catalyst.bin: header checksum mismatch");
+    }
+    if (expected_size(header) != content.size()) {
+        return std::unexpected("Malformed .catalyst.bin: section sizes do not match the file size");
     }
 
-    const char *ptr = content.data() + sizeof(BinHeader);
-    const char *strings_base = content.data() + content.size() - header->strings_size;
-
-    auto get_sv = [&](StringRef ref) -> std::string_view { return {strings_base + ref.offset, ref.len}; };
+    SectionReader reader(content.data() + sizeof(BinHeader));
+    auto definitions = reader.take<BinDefinition>(header.num_definitions);
+    auto bin_pools = reader.take<BinPool>(header.num_pools);
+    auto bin_dirs = reader.take<BinDir>(header.num_dirs);
+    auto bin_nodes = reader.take<BinNode>(header.num_nodes);
+    auto edge_offsets = reader.take<uint32_t>(size_t{header.num_nodes} + 1);
+    auto edges = reader.take<uint32_t>(header.num_edges);
+    auto bin_steps = reader.take<BinStep>(header.num_steps);
+    auto step_inputs = reader.take<uint32_t>(header.num_step_inputs);
+    auto index = reader.take<uint32_t>(header.num_index_slots);
+    std::string_view strings = content.substr(content.size() - header.strings_size);
+
+    // Ids are trusted from here on, so everything that indexes something is checked once.
+    constexpr uint32_t empty_slot = BuildGraph::INDEX_EMPTY;
+    auto ids_valid = [&](std::span<const uint32_t> ids, bool allow_empty) {
+        return std::ranges::all_of(ids, [&](uint32_t id) {
+            return id < header.num_nodes || (allow_empty && id == empty_slot);
+        });
+    };
+    auto string_valid = [&](BinString ref) { return uint64_t{ref.offset} + ref.len <= strings.size(); };
+    if (!ids_valid(edges, false) || !ids_valid(step_inputs, false) || !ids_valid(index, true)) {
+        return std::unexpected("Malformed .catalyst.bin: node id out of range");
+    }
+    if (header.num_nodes > 0 && (!std::has_single_bit(index.size()) || index.size() <= header.num_nodes)) {
+        return std::unexpected("Malformed .catalyst.bin: bad path index size");
+    }
+    // Lookups probe until they hit an empty slot.
+    if (!index.empty() && std::ranges::find(index, empty_slot) == index.end()) {
+        return std::unexpected("Malformed .catalyst.bin: path index has no free slot");
+    }
+    // Every edge leads to an output; `step_dag` maps it to the step producing it.
+    if (!std::ranges::all_of(edges, [&](uint32_t to) { return bin_nodes[to].step_id != bin_no_step; })) {
+        return std::unexpected("Malformed .catalyst.bin: edge to a node no step produces");
+    }
+    auto get_sv = [&](BinString ref) -> std::string_view { return strings.substr(ref.offset, ref.len); };
 
     // 1. Definitions
-    for (uint64_t i = 0; i < header->num_definitions; ++i) {
-        const auto *def = reinterpret_cast<const BinDefinition *>(ptr);
-        builder.add_definition(get_sv(def->key), get_sv(def->val));
-        ptr += sizeof(BinDefinition);
+    for (const auto &def : definitions) {
+        if (!string_valid(def.key) || !string_valid(def.val)) {
+            return std::unexpected("Malformed .catalyst.bin: string out of range");
+        }
+        builder.add_definition(get_sv(def.key), get_sv(def.val));
     }
-
-    // 2. Nodes
-    builder.graph_.nodes_.reserve(header->num_nodes);
-    for (uint64_t i = 0; i < header->num_nodes; ++i) {
-        StringRef path_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        uint64_t step_id_raw = *reinterpret_cast<const uint64_t *>(ptr);
-        ptr += sizeof(uint64_t);
-        uint64_t num_out_edges = *reinterpret_cast<const uint64_t *>(ptr);
-        ptr += sizeof(uint64_t);
-
-        std::optional<size_t> step_id = (step_id_raw == UINT64_MAX) ? std::nullopt : std::make_optional(step_id_raw);
-        std::vector<size_t> out_edges;
-        out_edges.reserve(num_out_edges);
-        for (uint64_t j = 0; j < num_out_edges; ++j) {
-            out_edges.push_back(*reinterpret_cast<const uint64_t *>(ptr));
-            ptr += sizeof(uint64_t);
+    for (const auto &pool : bin_pools) {
+        if (!string_valid(pool.name)) {
+            return std::unexpected("Malformed .catalyst.bin: string out of range");
         }
-
-        std::string_view path = get_sv(path_ref);
-        builder.graph_.nodes_.push_back({path, std::move(out_edges), step_id});
-        builder.graph_.index_.emplace(path, i);
+        builder.add_pool(get_sv(pool.name), pool.depth);
     }
 
-    // 3. Steps
-    builder.graph_.steps_.reserve(header->num_steps);
-    for (uint64_t i = 0; i < header->num_steps; ++i) {
-        StringRef tool_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        StringRef inputs_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        StringRef output_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        uint64_t depfile_count = *reinterpret_cast<const uint64_t *>(ptr);
-        ptr += sizeof(uint64_t);
-
-        std::optional<std::vector<std::string_view>> depfile_inputs;
-        if (depfile_count != UINT64_MAX) {
-            depfile_inputs.emplace();
-            depfile_inputs->reserve(depfile_count);
-            for (uint64_t j = 0; j < depfile_count; ++j) {
-                StringRef ref = *reinterpret_cast<const StringRef *>(ptr);
-                ptr += sizeof(StringRef);
-                depfile_inputs->push_back(get_sv(ref));
-            }
+    // 2. Directories; parents always precede their children.
+    BuildGraph &graph = builder.graph_;
+    graph.dirs_.resize(header.num_dirs);
+    for (size_t i = 0; i < bin_dirs.size(); ++i) {
+        const BinDir &bd = bin_dirs[i];
+        if (!string_valid(bd.path) || (bd.parent != BuildGraph::NO_DIR && bd.parent >= i)) {
+            return std::unexpected(std::format("Malformed .catalyst.bin: bad directory record {}", i));
         }
+        graph.dirs_[i] = {.path = get_sv(bd.path), .parent = bd.parent};
+    }
 
-        std::vector<std::string_view> parsed_inputs;
-        std::string_view remaining = get_sv(inputs_ref);
-        while (!remaining.empty()) {
-            size_t comma_pos = remaining.find(',');
-            std::string_view in_path;
-            if (comma_pos == std::string_view::npos) {
-                in_path = remaining;
-                remaining = {};
-            } else {
-                in_path = remaining.substr(0, comma_pos);
-                remaining = remaining.substr(comma_pos + 1);
-            }
-            if (!in_path.empty()) {
-                parsed_inputs.push_back(in_path);
-            }
+    // 3. Nodes: out-edges point into the edge section.
+    graph.nodes_.resize(header.num_nodes);
+    if (edge_offsets.front() != 0 || edge_offsets.back() != header.num_edges) {
+        return std::unexpected("Malformed .catalyst.bin: bad edge offsets");
+    }
+    for (size_t i = 0; i < bin_nodes.size(); ++i) {
+        const BinNode &bn = bin_nodes[i];
+        if (!string_valid(bn.path) || edge_offsets[i] > edge_offsets[i + 1] || bn.dir >= header.num_dirs ||
+            (bn.step_id != bin_no_step && bn.step_id >= header.num_steps)) {
+            return std::unexpected(std::format("Malformed .catalyst.bin: bad node record {}", i));
         }
+        auto &node = graph.nodes_[i];
+        node.path = get_sv(bn.path);
+        node.out_edges = edges.subspan(edge_offsets[i], edge_offsets[i + 1] - edge_offsets[i]);
+        node.step_id = bn.step_id == bin_no_step ? std::nullopt : std::make_optional<size_t>(bn.step_id);
+        node.dir = bn.dir;
+    }
 
-        builder.graph_.steps_.push_back({get_sv(tool_ref),
-                                         get_sv(inputs_ref),
-                                         get_sv(output_ref),
-                                         std::nullopt,
-                                         std::move(depfile_inputs),
-                                         std::move(parsed_inputs)});
+    // 4. Steps: inputs point into the step input section, already split by kind.
+    graph.steps_.resize(header.num_steps);
+    for (size_t i = 0; i < bin_steps.size(); ++i) {
+        const BinStep &bs = bin_steps[i];
+        if (!string_valid(bs.tool) || !string_valid(bs.inputs) || !string_valid(bs.pool) ||
+            bs.output_node >= header.num_nodes || bin_nodes[bs.output_node].step_id != i ||
+            bs.begin > bs.explicit_end || bs.explicit_end > bs.opaque_end || bs.opaque_end > bs.end ||
+            bs.end > header.num_step_inputs) {
+            return std::unexpected(std::format("Malformed .catalyst.bin: bad step record {}", i));
+        }
+        auto &step = graph.steps_[i];
+        step.tool = get_sv(bs.tool);
+        step.inputs = get_sv(bs.inputs);
+        step.pool = get_sv(bs.pool);
+        step.restat = (bs.flags & bin_step_restat) != 0;
+        step.output = graph.nodes_[bs.output_node].path;
+        step.output_node = bs.output_node;
+        step.input_nodes = step_inputs.subspan(bs.begin, bs.end - bs.begin);
+        step.parsed_inputs = step_inputs.subspan(bs.begin, bs.explicit_end - bs.begin);
+        step.opaque_inputs = step_inputs.subspan(bs.explicit_end, bs.opaque_end - bs.explicit_end);
+        step.depfile_inputs = step_inputs.subspan(bs.opaque_end, bs.end - bs.opaque_end);
     }
 
+    // 5. Path index, probed in place.
+    graph.index_ = index;
+    graph.finalized_ = true;
+
     builder.add_resource(file);
     return {};
 }
 
 Result<void> emit_bin(CBEBuilder &builder) {
-    std::ofstream out(".catalyst.bin", std::ios::binary);
-    if (!out) {
-        return std::unexpected("Failed to open .catalyst.bin for writing");
-    }
+    BuildGraph &graph = builder.graph_;
+    graph.finalize();
 
     StringBuffer sb;
     const auto &definitions = builder.definitions();
-    const auto &nodes = builder.graph().nodes();
-    const auto &steps = builder.graph().steps();
+    const auto &nodes = graph.nodes();
+    const auto &steps = graph.steps();
 
     std::vector<BinDefinition> bin_defs;
+    bin_defs.reserve(definitions.size());
     for (const auto &[k, v] : definitions) {
-        bin_defs.push_back({sb.add(k), sb.add(v)});
+        bin_defs.push_back({.key = sb.add(k), .val = sb.add(v)});
+    }
+
+    std::vector<BinPool> bin_pools;
+    bin_pools.reserve(builder.pools().size());
+    for (const auto &[name, depth] : builder.pools()) {
+        bin_pools.push_back(
+            {.name = sb.add(name), .depth = static_cast<uint32_t>(std::min<size_t>(depth, UINT32_MAX))});
     }
 
-    // Nodes and steps are variable length, we'll write them in two passes or buffer.
-    // Let's buffer to calculate sizes.
-    std::vector<char> nodes_buf;
+    std::vector<BinDir> bin_dirs;
+    bin_dirs.reserve(graph.dirs().size());
+    for (const auto &dir : graph.dirs()) {
+        bin_dirs.push_back({.path = sb.add(dir.path), .parent = dir.parent});
+    }
+
+    std::vector<BinNode> bin_nodes;
+    std::vector<uint32_t> edge_offsets;
+    std::vector<uint32_t> edges;
+    bin_nodes.reserve(nodes.size());
+    edge_offsets.reserve(nodes.size() + 1);
+    edge_offsets.push_back(0);
     for (const auto &node : nodes) {
-        StringRef path_ref = sb.add(node.path);
-        nodes_buf.insert(nodes_buf.end(),
-                         reinterpret_cast<const char *>(&path_ref),
-                         reinterpret_cast<const char *>(&path_ref) + sizeof(StringRef));
-
-        uint64_t step_id = node.step_id.value_or(UINT64_MAX);
-        nodes_buf.insert(nodes_buf.end(),
-                         reinterpret_cast<const char *>(&step_id),
-                         reinterpret_cast<const char *>(&step_id) + sizeof(uint64_t));
-
-        uint64_t num_out_edges = node.out_edges.size();
-        nodes_buf.insert(nodes_buf.end(),
-                         reinterpret_cast<const char *>(&num_out_edges),
-                         reinterpret_cast<const char *>(&num_out_edges) + sizeof(uint64_t));
-
-        for (size_t edge : node.out_edges) {
-            uint64_t edge_u64 = edge;
-            nodes_buf.insert(nodes_buf.end(),
-                             reinterpret_cast<const char *>(&edge_u64),
-                             reinterpret_cast<const char *>(&edge_u64) + sizeof(uint64_t));
-        }
+        bin_nodes.push_back({.path = sb.add(node.path),
+                             .step_id = node.step_id ? static_cast<uint32_t>(*node.step_id) : bin_no_step,
+                             .dir = node.dir});
+        edges.insert(edges.end(), node.out_edges.begin(), node.out_edges.end());
+        edge_offsets.push_back(static_cast<uint32_t>(edges.size()));
     }
 
-    std::vector<char> steps_buf;
+    std::vector<BinStep> bin_steps;
+    std::vector<uint32_t> step_inputs;
+    bin_steps.reserve(steps.size());
     for (const auto &step : steps) {
-        StringRef tool_ref = sb.add(step.tool);
-        StringRef inputs_ref = sb.add(step.inputs);
-        StringRef output_ref = sb.add(step.output);
-
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&tool_ref),
-                         reinterpret_cast<const char *>(&tool_ref) + sizeof(StringRef));
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&inputs_ref),
-                         reinterpret_cast<const char *>(&inputs_ref) + sizeof(StringRef));
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&output_ref),
-                         reinterpret_cast<const char *>(&output_ref) + sizeof(StringRef));
-
-        uint64_t depfile_count = step.depfile_inputs ? step.depfile_inputs->size() : UINT64_MAX;
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&depfile_count),
-                         reinterpret_cast<const char *>(&depfile_count) + sizeof(uint64_t));
-
-        if (step.depfile_inputs) {
-            for (const auto &di : *step.depfile_inputs) {
-                StringRef ref = sb.add(di);
-                steps_buf.insert(steps_buf.end(),
-                                 reinterpret_cast<const char *>(&ref),
-                                 reinterpret_cast<const char *>(&ref) + sizeof(StringRef));
-            }
-        }
+        // `input_nodes` is the explicit, opaque and depfile ranges back to back.
+        auto begin = static_cast<uint32_t>(step_inputs.size());
+        step_inputs.insert(step_inputs.end(), step.input_nodes.begin(), step.input_nodes.end());
+        auto explicit_end = begin + static_cast<uint32_t>(step.parsed_inputs.size());
+        auto opaque_end = explicit_end + static_cast<uint32_t>(step.opaque_inputs.size());
+        bin_steps.push_back({.tool = sb.add(step.tool),
+                             .inputs = sb.add(step.inputs),
+                             .pool = sb.add(step.pool),
+                             .flags = step.restat ? bin_step_restat : 0,
+                             .output_node = step.output_node,
+                             .begin = begin,
+                             .explicit_end = explicit_end,
+                             .opaque_end = opaque_end,
+                             .end = static_cast<uint32_t>(step_inputs.size())});
+    }
+
+    if (sb.data().size() > UINT32_MAX || step_inputs.size() >= UINT32_MAX || edges.size() >= UINT32_MAX ||
+        nodes.size() >= UINT32_MAX) {
+        return std::unexpected("Build graph is too large for .catalyst.bin");
     }
 
     BinHeader header{};
-#ifdef __linux__
-    std::memcpy(header.magic.data(), "CATBL001", bin_header_magic_bit_len);
-#elifdef __apple__
-    std::memcpy(header.magic, "CATBM001", 8);
-#elifdef _WIN32 || _WIN64
-    std::memcpy(header.magic, "CATBW001", 8);
-#endif
-    header.num_definitions = bin_defs.size();
-    header.num_nodes = nodes.size();
-    header.num_steps = steps.size();
+    std::memcpy(header.magic.data(), bin_magic.data(), bin_header_magic_bit_len);
+    header.num_definitions = static_cast<uint32_t>(bin_defs.size());
+    header.num_dirs = static_cast<uint32_t>(bin_dirs.size());
+    header.num_nodes = static_cast<uint32_t>(nodes.size());
+    header.num_steps = static_cast<uint32_t>(steps.size());
+    header.num_edges = static_cast<uint32_t>(edges.size());
+    header.num_step_inputs = static_cast<uint32_t>(step_inputs.size());
+    header.num_index_slots = static_cast<uint32_t>(graph.index_.size());
+    header.num_pools = static_cast<uint32_t>(bin_pools.size());
     header.strings_size = sb.data().size();
+    header.checksum = header_checksum(header);
+
+    // Written aside and renamed, so a concurrent or interrupted run never maps a torn file.
+    const std::filesystem::path tmp_path = ".catalyst.bin.tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return std::unexpected("Failed to open .catalyst.bin for writing");
+        }
+        write_section(out, std::span<const BinHeader>(&header, 1));
+        write_section<BinDefinition>(out, bin_defs);
+        write_section<BinPool>(out, bin_pools);
+        write_section<BinDir>(out, bin_dirs);
+        write_section<BinNode>(out, bin_nodes);
+        write_section<uint32_t>(out, edge_offsets);
+        write_section<uint32_t>(out, edges);
+        write_section<BinStep>(out, bin_steps);
+        write_section<uint32_t>(out, step_inputs);
+        write_section(out, graph.index_);
+        write_section<char>(out, sb.data());
+        if (!out) {
+            return std::unexpected("Failed to write .catalyst.bin");
+        }
+    }
 
-    // NOLINTBEGIN(cppcoreguidelines-narrowing-conversions, bugprone-narrowing-conversions)
-    out.write(reinterpret_cast<const char *>(&header), sizeof(BinHeader));
-    out.write(reinterpret_cast<const char *>(bin_defs.data()), bin_defs.size() * sizeof(BinDefinition));
-    out.write(nodes_buf.data(), nodes_buf.size());
-    out.write(steps_buf.data(), steps_buf.size());
-    out.write(sb.data().data(), sb.data().size());
-
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, ".catalyst.bin", ec);
+    if (ec) {
+        return std::unexpected(std::format("Failed to write .catalyst.bin: {}", ec.message()));
+    }
     return {};
-    // NOLINTEND(cppcoreguidelines-narrowing-conversions, bugprone-narrowing-conversions)
+}
+
+void invalidate_bin() {
+    std::error_code ec;
+    std::filesystem::remove(".catalyst.bin", ec);
 }
 
 } // namespace catalyst
@@ -0,0 +1,166 @@
+#include "cbe/build_log.hpp"
+
+#include "cbe/hash.hpp"
+#include "cbe/mmap.hpp"
+#include "cbe/utility.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace catalyst {
+
+namespace {
+
+constexpr std::string_view log_signature = "# catalyst log v1";
+
+// Compaction only kicks in once the log is reasonably large and mostly dead records.
+constexpr size_t TUNABLE__compaction_min_records = 1000;
+constexpr size_t TUNABLE__compaction_dead_ratio = 3;
+
+std::string format_record(std::string_view output, const BuildLog::Record &record) {
+    std::string line = std::format("{}|{:x}", output, record.command_hash);
+    if (record.inputs_digest)
+        std::format_to(std::back_inserter(line), "#{}", record.inputs_digest->hex());
+    if (record.built_at) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(record.built_at->time_since_epoch());
+        std::format_to(std::back_inserter(line), "@{}", ns.count());
+    }
+    line += '\n';
+    return line;
+}
+
+} // namespace
+
+BuildLog::BuildLog(const std::filesystem::path &path) : path_(path) {
+    try {
+        log_file_keep_alive_ = std::make_shared<MappedFile>(path_);
+    } catch (const std::runtime_error &) {
+        return;
+    }
+
+    std::string_view content = log_file_keep_alive_->content();
+    if (!content.starts_with(log_signature)) {
+        // Unknown version or garbage: ignore it, it will be rewritten on open_for_append().
+        return;
+    }
+
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string_view::npos) {
+            // A torn final record (e.g. from a killed build) is ignored.
+            break;
+        }
+        std::string_view line = content.substr(start, end - start);
+        start = end + 1;
+
+        if (line.empty() || line.starts_with('#'))
+            continue;
+
+        // format SHOULD ALWAYS be: <output>|<command_hash_as_hex>[#<inputs_digest_as_hex>][@<built_at_ns>]
+        auto pipe_pos = line.rfind('|');
+        if (pipe_pos == std::string_view::npos)
+            continue;
+
+        Record record;
+        std::string_view hash_str = line.substr(pipe_pos + 1);
+        auto [ptr, ec] = std::from_chars(hash_str.data(), hash_str.data() + hash_str.size(), record.command_hash, 16);
+        if (ec != std::errc{})
+            continue;
+        std::string_view digest_str = hash_str.substr(ptr - hash_str.data());
+        std::string_view built_at_str;
+        if (size_t at_pos = digest_str.find('@'); at_pos != std::string_view::npos) {
+            built_at_str = digest_str.substr(at_pos + 1);
+            digest_str = digest_str.substr(0, at_pos);
+        }
+        if (digest_str.size() == 33 && digest_str[0] == '#') {
+            Digest digest;
+            const char *mid = digest_str.data() + 17;
+            auto high = std::from_chars(digest_str.data() + 1, mid, digest.high, 16);
+            auto low = std::from_chars(mid, digest_str.data() + digest_str.size(), digest.low, 16);
+            if (high.ec == std::errc{} && low.ec == std::errc{})
+                record.inputs_digest = digest;
+        }
+        if (int64_t ns = 0;
+            !built_at_str.empty() &&
+            std::from_chars(built_at_str.data(), built_at_str.data() + built_at_str.size(), ns).ec == std::errc{}) {
+            record.built_at = std::filesystem::file_time_type(
+                std::chrono::duration_cast<std::filesystem::file_time_type::duration>(std::chrono::nanoseconds(ns)));
+        }
+
+        entries_.insert_or_assign(line.substr(0, pipe_pos), record);
+        total_records_++;
+    }
+}
+
+Result<void> BuildLog::compact() {
+    auto tmp_path = path_;
+    tmp_path += ".tmp";
+    {
+        std::ofstream tmp(tmp_path, std::ios::trunc);
+        if (!tmp) {
+            return std::unexpected(std::format("Failed to open {} for writing", tmp_path.string()));
+        }
+        tmp << log_signature << '\n';
+        for (const auto &[output, record] : entries_) {
+            tmp << format_record(output, record);
+        }
+        if (!tmp) {
+            return std::unexpected(std::format("Failed to write {}", tmp_path.string()));
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path_, ec);
+    if (ec) {
+        return std::unexpected(std::format("Failed to replace {}: {}", path_.string(), ec.message()));
+    }
+    total_records_ = entries_.size();
+    return {};
+}
+
+Result<void> BuildLog::open_for_append() {
+    if (out_.is_open())
+        return {};
+
+    bool fresh = !log_file_keep_alive_ || !log_file_keep_alive_->content().starts_with(log_signature);
+    bool bloated = total_records_ > TUNABLE__compaction_min_records &&
+                   total_records_ > TUNABLE__compaction_dead_ratio * entries_.size();
+    if (fresh || bloated) {
+        if (auto res = compact(); !res)
+            return res;
+    }
+
+    out_.open(path_, std::ios::app);
+    if (!out_) {
+        return std::unexpected(std::format("Failed to open {} for appending", path_.string()));
+    }
+    return {};
+}
+
+void BuildLog::record(std::string_view output, const Record &record) {
+    std::lock_guard lock(write_mtx_);
+    if (!out_.is_open())
+        return;
+    // Later staleness checks over the same graph (watch mode) must see the new hash.
+    if (auto it = entries_.find(output); it != entries_.end()) {
+        it->second = record;
+    } else {
+        entries_.emplace(recorded_outputs_.emplace_back(output), record);
+    }
+    total_records_++;
+    out_ << format_record(output, record);
+    out_.flush();
+}
+
+} // namespace catalyst
@@ -11,7 +11,7 @@
 #include <string>
 
 void printHelp() {
-    std::println("Usage: cbe [options]");
+    std::println("Usage: cbe [options] [targets...]");
     std::println("Options:");
     std::println("  -h, --help       Show this help message");
     std::println("  -v, --version    Show version");
@@ -19,10 +19,22 @@ void printHelp() {
     std::println("  -e <estimate>    Use <estimate> as the estimate file (default: catalyst.estimates)");
     std::println("  -f <file>        Use <file> as the build manifest (default: catalyst.build)");
     std::println("  -j, --jobs <N>   Set number of parallel jobs (default: auto)");
+    std::println("  --memory-budget <MiB>");
+    std::println("                   Only start steps whose predicted peak memory fits (default: no limit)");
+    std::println("  --schedule <p>   Ready queue order: critical-path or estimate (default: critical-path)");
+    std::println("  --no-jobserver   Neither join make's jobserver nor provide one to the steps");
+    std::println("  --hash           Rebuild when input contents change, not when mtimes do");
+    std::println("  --cache <dir>    Restore cc, cxx and ld outputs from <dir> and store new ones there");
+    std::println("  --cache-size <MiB>");
+    std::println("                   Evict least recently used artifacts beyond this (default: 5120)");
     std::println("  --dry-run        Print commands without executing them");
+    std::println("  --explain        Print why each out-of-date step has to run");
     std::println("  --clean          Remove build artifacts");
     std::println("  --compdb         Generate compile_commands.json");
     std::println("  --graph          Generate DOT graph of build");
+    std::println("  --watch          Build, then rebuild whenever an input changes");
+    std::println("Targets are outputs, or prefixes ending in '/' (e.g. build/net/); only they and");
+    std::println("what they depend on are built. Without targets, everything is built.");
 }
 
 void printVersion() {
@@ -33,6 +45,7 @@ struct CliArgs {
     catalyst::ExecutorConfig config;
     bool compdb = false;
     bool graph = false;
+    bool watch = false;
     std::string input_path = "catalyst.build";
     std::string estimates_file = "catalyst.estimates";
     std::filesystem::path work_dir = std::filesystem::current_path();
@@ -46,7 +59,7 @@ int main(const int argc, const char *const *argv) {
         std::println(std::cerr, "{}", res.error());
         return 1;
     }
-    const auto [config, compdb, graph, input_path, estimates_file, work_dir] = *res;
+    const auto [config, compdb, graph, watch, input_path, estimates_file, work_dir] = *res;
 
     if (work_dir != ".") {
         std::error_code ec;
@@ -58,6 +71,7 @@ int main(const int argc, const char *const *argv) {
     }
 
     catalyst::CBEBuilder builder;
+    builder.set_deps_file(config.deps_file);
 
     if (!std::filesystem::exists(input_path)) {
         std::println(std::cerr, "Build File: {} does not exist.", input_path);
@@ -80,6 +94,21 @@ int main(const int argc, const char *const *argv) {
         auto _ = executor.emit_compdb();
     } else if (graph) {
         auto _ = executor.emit_graph();
+    } else if (watch) {
+        for (;;) {
+            if (auto res = executor.watch(); !res) {
+                std::println(std::cerr, "Watch failed: {}", res.error());
+                return 1;
+            }
+            // The manifest or a step's discovered inputs changed: start over from a fresh graph.
+            catalyst::CBEBuilder fresh;
+            fresh.set_deps_file(config.deps_file);
+            if (auto res = catalyst::parse(fresh, input_path); !res) {
+                std::println(std::cerr, "Failed to parse: {}", res.error());
+                return 1;
+            }
+            executor = catalyst::Executor{std::move(fresh), config};
+        }
     } else if (config.clean) {
         if (auto res = executor.clean(); !res) {
             std::println(std::cerr, "Clean failed: {}", res.error());
@@ -135,12 +164,34 @@ catalyst::Result<CliArgs> CLIArgs(const int argc, const char *const *argv) {
             }
         } else if (arg == "--dry-run") {
             par.config.dry_run = true;
+        } else if (arg == "--explain") {
+            par.config.explain = true;
         } else if (arg == "--clean") {
             par.config.clean = true;
         } else if (arg == "--compdb") {
             par.compdb = true;
         } else if (arg == "--graph") {
             par.graph = true;
+        } else if (arg == "--watch") {
+            par.watch = true;
+        } else if (arg == "--no-jobserver") {
+            par.config.jobserver = false;
+        } else if (arg == "--hash") {
+            par.config.hash = true;
+        } else if (arg == "--schedule") {
+            if (i + 1 < argc) {
+                std::string_view policy = argv[i + 1];
+                if (policy == "critical-path") {
+                    par.config.schedule = catalyst::SchedulePolicy::CRITICAL_PATH;
+                } else if (policy == "estimate") {
+                    par.config.schedule = catalyst::SchedulePolicy::ESTIMATE;
+                } else {
+                    return std::unexpected(std::format("Invalid schedule policy: {}", policy));
+                }
+                i++;
+            } else {
+                return std::unexpected(std::format("Missing argument for {}", arg));
+            }
         } else if (arg == "-j" || arg == "--jobs") {
             if (i + 1 < argc) {
                 size_t jobs = 0;
@@ -154,9 +205,48 @@ catalyst::Result<CliArgs> CLIArgs(const int argc, const char *const *argv) {
             } else {
                 return std::unexpected(std::format("Missing argument for {}", arg));
             }
+        } else if (arg == "--memory-budget") {
+            if (i + 1 < argc) {
+                size_t budget = 0;
+                auto res = std::from_chars(argv[i + 1], argv[i + 1] + strlen(argv[i + 1]), budget);
+                if (res.ec == std::errc() && budget != 0) {
+                    par.config.memory_budget_mib = budget;
+                    i++;
+                } else {
+                    return std::unexpected(std::format("Invalid memory budget: {}", argv[i + 1]));
+                }
+            } else {
+                return std::unexpected(std::format("Missing argument for {}", arg));
+            }
+        } else if (arg == "--cache") {
+            if (i + 1 < argc) {
+                par.config.cache_dir = argv[i + 1];
+                i++;
+            } else {
+                return std::unexpected(std::format("Missing argument for {}", arg));
+            }
+        } else if (arg == "--cache-size") {
+            if (i + 1 < argc) {
+                size_t size = 0;
+                auto res = std::from_chars(argv[i + 1], argv[i + 1] + strlen(argv[i + 1]), size);
+                if (res.ec == std::errc() && size != 0) {
+                    par.config.cache_size_mib = size;
+                    i++;
+                } else {
+                    return std::unexpected(std::format("Invalid cache size: {}", argv[i + 1]));
+                }
+            } else {
+                return std::unexpected(std::format("Missing argument for {}", arg));
+            }
+        } else if (!arg.starts_with('-')) {
+            par.config.targets.emplace_back(arg);
         } else {
-            return std::unexpected(std::format("Unknown argument: {}. Run {} --help for more information.", argv[0], arg));
+            return std::unexpected(
+                std::format("Unknown argument: {}. Run {} --help for more information.", arg, argv[0]));
         }
     }
+    if (!par.config.targets.empty() && (par.config.clean || par.compdb || par.graph)) {
+        return std::unexpected("Targets cannot be combined with --clean, --compdb or --graph");
+    }
     return par;
 }
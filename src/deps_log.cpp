@@ -0,0 +1,192 @@
+#include "cbe/deps_log.hpp"
+
+#include "cbe/mmap.hpp"
+#include "cbe/utility.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+namespace catalyst {
+
+namespace {
+
+constexpr std::string_view deps_log_signature = "CATDL001";
+
+constexpr uint32_t deps_record_bit = 0x80000000U;
+constexpr uint32_t record_size_mask = 0x7fffffffU;
+
+// Compaction only kicks in once the log is reasonably large and mostly dead records.
+constexpr size_t TUNABLE__compaction_min_records = 1000;
+constexpr size_t TUNABLE__compaction_dead_ratio = 3;
+
+void append_u32(std::string &buf, uint32_t value) {
+    buf.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void append_path_record(std::string &buf, std::string_view path) {
+    const size_t padded = (path.size() + 4) & ~size_t{3}; // Always at least one NUL.
+    append_u32(buf, static_cast<uint32_t>(padded));
+    buf.append(path);
+    buf.append(padded - path.size(), '\0');
+}
+
+void append_deps_record(std::string &buf, uint32_t output, std::span<const uint32_t> deps) {
+    append_u32(buf, deps_record_bit | static_cast<uint32_t>((deps.size() + 1) * sizeof(uint32_t)));
+    append_u32(buf, output);
+    buf.append(reinterpret_cast<const char *>(deps.data()), deps.size_bytes());
+}
+
+} // namespace
+
+DepsLog::DepsLog(const std::filesystem::path &path) : path_(path) {
+    try {
+        log_file_keep_alive_ = std::make_shared<MappedFile>(path_);
+    } catch (const std::runtime_error &) {
+        return;
+    }
+
+    std::string_view content = log_file_keep_alive_->content();
+    if (!content.starts_with(deps_log_signature)) {
+        // Unknown version or garbage: ignore it, it will be rewritten on open_for_append().
+        return;
+    }
+
+    // Records are 4-byte aligned within a page-aligned mapping, so ids are read in place.
+    size_t pos = deps_log_signature.size();
+    while (pos + sizeof(uint32_t) <= content.size()) {
+        uint32_t head = 0;
+        std::memcpy(&head, content.data() + pos, sizeof(head));
+        const size_t size = head & record_size_mask;
+        if (size % sizeof(uint32_t) != 0 || size == 0 || size > content.size() - pos - sizeof(uint32_t))
+            break;
+        const char *payload = content.data() + pos + sizeof(uint32_t);
+
+        if ((head & deps_record_bit) != 0) {
+            std::span<const uint32_t> ids(reinterpret_cast<const uint32_t *>(payload), size / sizeof(uint32_t));
+            if (!std::ranges::all_of(ids, [&](uint32_t id) { return id < paths_.size(); }))
+                break;
+            deps_[ids.front()] = ids.subspan(1);
+            total_records_++;
+        } else {
+            std::string_view path(payload, size);
+            path = path.substr(0, path.find('\0'));
+            ids_.emplace(path, static_cast<uint32_t>(paths_.size()));
+            paths_.push_back(path);
+            deps_.emplace_back();
+        }
+        pos += sizeof(uint32_t) + size;
+        valid_size_ = pos;
+    }
+}
+
+uint32_t DepsLog::intern(std::string_view path, std::string &buf) {
+    if (auto it = ids_.find(path); it != ids_.end()) {
+        return it->second;
+    }
+    auto id = static_cast<uint32_t>(paths_.size());
+    std::string_view owned = recorded_paths_.emplace_back(path);
+    ids_.emplace(owned, id);
+    paths_.push_back(owned);
+    deps_.emplace_back();
+    append_path_record(buf, owned);
+    return id;
+}
+
+Result<void> DepsLog::compact() {
+    // Path ids are kept as they are, so only superseded deps records are dropped and
+    // nothing in memory needs renumbering.
+    std::string buf(deps_log_signature);
+    for (std::string_view path : paths_)
+        append_path_record(buf, path);
+    size_t live = 0;
+    for (size_t id = 0; id < deps_.size(); ++id) {
+        if (deps_[id]) {
+            append_deps_record(buf, static_cast<uint32_t>(id), *deps_[id]);
+            live++;
+        }
+    }
+
+    auto tmp_path = path_;
+    tmp_path += ".tmp";
+    {
+        std::ofstream tmp(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!tmp) {
+            return std::unexpected(std::format("Failed to open {} for writing", tmp_path.string()));
+        }
+        tmp.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        if (!tmp) {
+            return std::unexpected(std::format("Failed to write {}", tmp_path.string()));
+        }
+    }
+
+    // The old file stays mapped (and alive) until the log is destroyed.
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path_, ec);
+    if (ec) {
+        return std::unexpected(std::format("Failed to replace {}: {}", path_.string(), ec.message()));
+    }
+    total_records_ = live;
+    valid_size_ = buf.size();
+    return {};
+}
+
+Result<void> DepsLog::open_for_append() {
+    if (out_.is_open())
+        return {};
+
+    const bool fresh = !log_file_keep_alive_ || !log_file_keep_alive_->content().starts_with(deps_log_signature);
+    const bool torn = !fresh && valid_size_ != log_file_keep_alive_->content().size();
+    size_t live = 0;
+    for (const auto &deps : deps_)
+        live += deps.has_value() ? 1 : 0;
+    const bool bloated =
+        total_records_ > TUNABLE__compaction_min_records && total_records_ > TUNABLE__compaction_dead_ratio * live;
+    // Rewriting also drops a torn tail, so appends start on a record boundary.
+    if (fresh || torn || bloated) {
+        if (auto res = compact(); !res)
+            return res;
+    }
+
+    out_.open(path_, std::ios::binary | std::ios::app);
+    if (!out_) {
+        return std::unexpected(std::format("Failed to open {} for appending", path_.string()));
+    }
+    return {};
+}
+
+Result<void> DepsLog::record(std::string_view output, std::span<const std::string_view> deps) {
+    std::lock_guard lock(write_mtx_);
+    if (!out_.is_open())
+        return std::unexpected(std::format("{} is not open for appending", path_.string()));
+
+    // New paths are written ahead of the record that first uses them, in the same write.
+    std::string buf;
+    const uint32_t output_id = intern(output, buf);
+    auto &ids = recorded_deps_.emplace_back();
+    ids.reserve(deps.size());
+    for (std::string_view dep : deps)
+        ids.push_back(intern(dep, buf));
+    append_deps_record(buf, output_id, ids);
+
+    deps_[output_id] = std::span<const uint32_t>(ids);
+    total_records_++;
+    out_.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    out_.flush();
+    if (!out_) {
+        return std::unexpected(std::format("Failed to append to {}", path_.string()));
+    }
+    return {};
+}
+
+} // namespace catalyst
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
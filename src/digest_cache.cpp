@@ -0,0 +1,152 @@
+#include "cbe/digest_cache.hpp"
+
+#include "cbe/hash.hpp"
+#include "cbe/mmap.hpp"
+#include "cbe/stat_batch.hpp"
+#include "cbe/utility.hpp"
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+
+namespace catalyst {
+
+namespace {
+
+constexpr std::string_view digests_signature = "# catalyst digests v1";
+
+int64_t mtime_ns(const StatResult &stat) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(stat.time.time_since_epoch()).count();
+}
+
+template <typename T> bool parse_number(std::string_view text, T &value, int base = 10) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+}
+
+} // namespace
+
+DigestCache::DigestCache(const std::filesystem::path &path) : path_(path) {
+    try {
+        file_keep_alive_ = std::make_shared<MappedFile>(path_);
+    } catch (const std::runtime_error &) {
+        return;
+    }
+
+    std::string_view content = file_keep_alive_->content();
+    if (!content.starts_with(digests_signature))
+        return;
+    saved_at_ns_ = table_mtime_ns().value_or(0);
+
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string_view::npos)
+            break;
+        std::string_view line = content.substr(start, end - start);
+        start = end + 1;
+        if (line.empty() || line.starts_with('#'))
+            continue;
+
+        // <path>|<inode>|<size>|<mtime_ns>|<digest>; the path may itself contain '|'.
+        std::array<std::string_view, 4> fields;
+        bool ok = true;
+        for (size_t i = fields.size(); i-- > 0;) {
+            const size_t pipe_pos = line.rfind('|');
+            if (pipe_pos == std::string_view::npos) {
+                ok = false;
+                break;
+            }
+            fields[i] = line.substr(pipe_pos + 1);
+            line = line.substr(0, pipe_pos);
+        }
+        Entry entry;
+        if (!ok || fields[3].size() != 32 || !parse_number(fields[0], entry.inode) ||
+            !parse_number(fields[1], entry.size) || !parse_number(fields[2], entry.mtime_ns) ||
+            !parse_number(fields[3].substr(0, 16), entry.digest.high, 16) ||
+            !parse_number(fields[3].substr(16), entry.digest.low, 16))
+            continue;
+        entry.verified = entry.mtime_ns < saved_at_ns_;
+        entries_.insert_or_assign(line, entry);
+    }
+}
+
+std::optional<int64_t> DigestCache::table_mtime_ns() const {
+    std::error_code ec;
+    const auto time = std::filesystem::last_write_time(path_, ec);
+    if (ec)
+        return std::nullopt;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::optional<Digest> DigestCache::digest(std::string_view path, const StatResult &stat) {
+    if (stat.ec)
+        return std::nullopt;
+    const Entry current{.inode = stat.inode, .size = stat.size, .mtime_ns = mtime_ns(stat), .digest = {}};
+    {
+        std::shared_lock lock(mtx_);
+        if (auto it = entries_.find(path); it != entries_.end()) {
+            const Entry &entry = it->second;
+            if (entry.verified && entry.inode == current.inode && entry.size == current.size &&
+                entry.mtime_ns == current.mtime_ns)
+                return entry.digest;
+        }
+    }
+
+    ContentHasher hasher;
+    if (!hasher.update_file(path))
+        return std::nullopt;
+    Entry entry = current;
+    entry.digest = hasher.digest();
+
+    std::unique_lock lock(mtx_);
+    if (auto it = entries_.find(path); it != entries_.end())
+        it->second = entry;
+    else
+        entries_.emplace(added_paths_.emplace_back(path), entry);
+    changed_ = true;
+    return entry.digest;
+}
+
+Result<void> DigestCache::save() {
+    std::unique_lock lock(mtx_);
+    if (!changed_)
+        return {};
+
+    auto tmp_path = path_;
+    tmp_path += ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        if (!out)
+            return std::unexpected(std::format("Failed to open {} for writing", tmp_path.string()));
+        out << digests_signature << '\n';
+        for (const auto &[path, entry] : entries_) {
+            out << std::format(
+                "{}|{}|{}|{}|{}\n", path, entry.inode, entry.size, entry.mtime_ns, entry.digest.hex());
+        }
+        if (!out)
+            return std::unexpected(std::format("Failed to write {}", tmp_path.string()));
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path_, ec);
+    if (ec)
+        return std::unexpected(std::format("Failed to replace {}: {}", path_.string(), ec.message()));
+    saved_at_ns_ = table_mtime_ns().value_or(0);
+    for (auto &[path, entry] : entries_)
+        entry.verified = entry.mtime_ns < saved_at_ns_;
+    changed_ = false;
+    return {};
+}
+
+} // namespace catalyst
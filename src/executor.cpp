@@ -1,31 +1,44 @@
 #include "cbe/executor.hpp"
 
+#include "cbe/binary.hpp"
+#include "cbe/build_log.hpp"
 #include "cbe/builder.hpp"
+#include "cbe/depfile.hpp"
+#include "cbe/deps_log.hpp"
+#include "cbe/digest_cache.hpp"
+#include "cbe/hash.hpp"
+#include "cbe/jobserver.hpp"
+#include "cbe/mmap.hpp"
 #include "cbe/process_exec.hpp"
+#include "cbe/renderer.hpp"
+#include "cbe/scheduler.hpp"
+#include "cbe/stat_batch.hpp"
 #include "cbe/utility.hpp"
 
+#include <algorithm>
 #include <atomic>
-#if FF_cbe__profiling
 #include <chrono>
-#endif
-#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <mutex>
 #include <nlohmann/json.hpp>
+#include <numeric>
+#include <optional>
 #include <ostream>
 #include <print>
-#include <queue>
 #include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
 #include <sys/mman.h>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace catalyst {
@@ -41,8 +54,344 @@ bool isNewer(const std::filesystem::path &new_file, const std::filesystem::path
     return new_time > old_time;
 }
 
+namespace {
+
+/** @brief One-line explanation of why a step is dirty, for `--explain`. */
+std::string describe(const BuildGraph &graph, const DirtyReason &reason) {
+    const std::string_view input = graph.nodes()[reason.node].path;
+    switch (reason.kind) {
+    case DirtyReason::KIND::CLEAN:
+        return "up to date";
+    case DirtyReason::KIND::MISSING_OUTPUT:
+        return "output is missing";
+    case DirtyReason::KIND::COMMAND_CHANGED:
+        return "command changed since the last build";
+    case DirtyReason::KIND::MISSING_INPUT:
+        return std::format("input {} is missing", input);
+    case DirtyReason::KIND::NEWER_INPUT:
+        return std::format("input {} is not older than the output", input);
+    case DirtyReason::KIND::CHANGED_CONTENT:
+        return "contents of the inputs changed since the last build";
+    case DirtyReason::KIND::DIRTY_INPUT:
+        return std::format("input {} is rebuilt first", input);
+    }
+    return "";
+}
+
+/**
+ * @brief Restricts `dag` to the given steps, renumbered densely in the given order.
+ *
+ * The steps must be closed under dependents within `in_scope`, so every edge out of them
+ * stays except those leaving the scope.
+ *
+ * @param task_of Scratch step-to-task map sized to the whole graph; only the entries of
+ *        `task_steps` are written, so the cost is independent of the graph size.
+ */
+BuildGraph::StepDag dirty_subdag(const BuildGraph::StepDag &dag,
+                                 std::span<const uint32_t> task_steps,
+                                 std::span<const uint8_t> in_scope,
+                                 std::vector<uint32_t> &task_of) {
+    for (size_t task = 0; task < task_steps.size(); ++task)
+        task_of[task_steps[task]] = static_cast<uint32_t>(task);
+
+    BuildGraph::StepDag sub;
+    sub.offsets.reserve(task_steps.size() + 1);
+    sub.offsets.push_back(0);
+    for (uint32_t step : task_steps) {
+        for (uint32_t i = dag.offsets[step]; i < dag.offsets[step + 1]; ++i) {
+            if (in_scope[dag.successors[i]])
+                sub.successors.push_back(task_of[dag.successors[i]]);
+        }
+        sub.offsets.push_back(static_cast<uint32_t>(sub.successors.size()));
+    }
+    return sub;
+}
+
+/**
+ * @brief The first of `inputs` that is missing or not older than the output, as a reason; `CLEAN` if none.
+ * An input stamped in the same tick as the output may have been edited after it was read.
+ */
+DirtyReason check_inputs(std::span<const uint32_t> inputs,
+                         std::filesystem::file_time_type output_modtime,
+                         StatCache &stat_cache) {
+    using enum DirtyReason::KIND;
+    for (uint32_t input : inputs) {
+        const StatResult input_stat = stat_cache.get(input);
+        if (input_stat.ec)
+            return {.kind = MISSING_INPUT, .node = input};
+        if (input_stat.time >= output_modtime)
+            return {.kind = NEWER_INPUT, .node = input};
+    }
+    return {};
+}
+
+/**
+ * @brief Digest of a step's inputs as paths and content digests (nothing for a missing file).
+ * Each input is mixed into one 128-bit value and the values are summed, so the order does not
+ * matter. Callers skip depfile entries that repeat an explicit input, as the source usually does.
+ */
+class InputSetDigest {
+public:
+    void add(std::string_view path, const std::optional<Digest> &digest) {
+        const Digest content = digest.value_or(Digest{});
+        const XXH128_hash_t mixed =
+            XXH3_128bits_withSeed(&content, sizeof(content), XXH3_64bits(path.data(), path.size()));
+        sum_.low += mixed.low64;
+        sum_.high += mixed.high64;
+    }
+
+    Digest digest() const {
+        return sum_;
+    }
+
+private:
+    Digest sum_;
+};
+
+/** @brief Digest of a file's contents, as `DigestCache` computes it; nothing if it cannot be read. */
+std::optional<Digest> file_digest(std::string_view path) {
+    ContentHasher hasher;
+    if (!hasher.update_file(path))
+        return std::nullopt;
+    return hasher.digest();
+}
+
+} // namespace
+
 Executor::Executor(CBEBuilder &&builder, const ExecutorConfig &config) : builder(std::move(builder)), config(config) {
     estimator = std::make_unique<WorkEstimate>(config.estimates_file);
+    rss_estimator = std::make_unique<WorkEstimate>(config.rss_file);
+    build_log = std::make_unique<BuildLog>(config.log_file);
+    if (config.hash)
+        digest_cache = std::make_unique<DigestCache>(config.digests_file);
+    if (!config.cache_dir.empty())
+        artifact_cache = std::make_unique<ArtifactCache>(config.cache_dir, uint64_t{config.cache_size_mib} << 20);
+
+    const auto &defs = this->builder.definitions();
+    auto split_def = [&](std::string_view key) {
+        std::vector<std::string> parts;
+        if (auto it = defs.find(key); it != defs.end()) {
+            // This __must__ be done otherwise optimizations will fuck up.
+            const std::string value(it->second);
+            for (const auto &part : std::ranges::views::split(value, ' ')) {
+                if (part.begin() != part.end()) {
+                    parts.push_back(std::ranges::to<std::string>(part));
+                }
+            }
+        }
+        return parts;
+    };
+
+    cc_vec = split_def("cc");
+    cxx_vec = split_def("cxx");
+    cflags_vec = split_def("cflags");
+    cxxflags_vec = split_def("cxxflags");
+    ldflags_vec = split_def("ldflags");
+    ldlibs_vec = split_def("ldlibs");
+}
+
+template <typename F>
+void Executor::for_each_arg(const BuildGraph &graph,
+                            const BuildStep &step,
+                            F &&emit,
+                            std::optional<std::string_view> rsp_file) const {
+    auto emit_parts = [&emit](const std::vector<std::string> &parts) {
+        for (const auto &part : parts)
+            emit(std::string_view(part));
+    };
+    auto emit_inputs = [&emit, &graph, &step]() {
+        for (uint32_t in : step.parsed_inputs)
+            emit(graph.nodes()[in].path);
+    };
+
+    if (step.tool == "cc" || step.tool == "cxx") {
+        const bool is_cc = step.tool == "cc";
+        emit_parts(is_cc ? cc_vec : cxx_vec);
+        emit_parts(is_cc ? cflags_vec : cxxflags_vec);
+        const std::string depfile = std::format("{}.d", step.output);
+        emit("-MMD");
+        emit("-MF");
+        emit(depfile);
+        emit("-c");
+        emit_inputs();
+        emit("-o");
+        emit(step.output);
+    } else if (step.tool == "ld") {
+        emit_parts(cxx_vec);
+        if (rsp_file) {
+            const std::string rsp_arg = std::format("@{}", *rsp_file);
+            emit(rsp_arg);
+        } else {
+            emit_inputs();
+        }
+        emit("-o");
+        emit(step.output);
+        emit_parts(ldflags_vec);
+        emit_parts(ldlibs_vec);
+    } else if (step.tool == "ar") {
+        emit("ar");
+        emit("rcs");
+        emit(step.output);
+        emit_inputs();
+    } else if (step.tool == "sld") {
+        emit_parts(cxx_vec);
+        emit("-shared");
+        emit_inputs();
+        emit("-o");
+        emit(step.output);
+    }
+}
+
+std::vector<std::string> Executor::expand_command(const BuildGraph &graph,
+                                                  const BuildStep &step,
+                                                  std::optional<std::string_view> rsp_file) const {
+    static constexpr auto ARGS_VEC_INIT_SZ = 40;
+    std::vector<std::string> args;
+    args.reserve(ARGS_VEC_INIT_SZ);
+    for_each_arg(graph, step, [&args](std::string_view arg) { args.emplace_back(arg); }, rsp_file);
+    return args;
+}
+
+uint64_t Executor::command_hash(const BuildGraph &graph, const BuildStep &step) const {
+    Fnv1a hasher;
+    hasher.update_arg(step.tool);
+    for_each_arg(graph, step, [&hasher](std::string_view arg) { hasher.update_arg(arg); });
+    // Opaque inputs never reach the command line, but adding or removing one should still rebuild.
+    for (uint32_t opaque : step.opaque_inputs) {
+        hasher.update("!");
+        hasher.update_arg(graph.nodes()[opaque].path);
+    }
+    return hasher.digest();
+}
+
+std::optional<Digest> Executor::artifact_key(const BuildGraph &graph, const BuildStep &step) const {
+    if (step.tool != "cc" && step.tool != "cxx" && step.tool != "ld")
+        return std::nullopt;
+    ContentHasher hasher;
+    hasher.update_arg(step.tool);
+    for_each_arg(graph, step, [&hasher](std::string_view arg) { hasher.update_arg(arg); });
+    const auto &inputs = step.input_nodes;
+    for (uint32_t input : inputs.first(inputs.size() - step.depfile_inputs.size())) {
+        const std::string_view path = graph.nodes()[input].path;
+        hasher.update_arg(path);
+        if (!hasher.update_file(path))
+            return std::nullopt;
+    }
+    return hasher.digest();
+}
+
+std::vector<size_t> Executor::task_costs(const BuildGraph &graph, std::span<const uint32_t> task_steps) const {
+    const auto &steps = graph.steps();
+    const size_t num_tasks = task_steps.size();
+
+    // Dense per-task cost table. Unknown steps cost the mean of the known ones.
+    std::vector<size_t> step_cost(num_tasks, 0);
+    size_t known_total = 0;
+    size_t known_count = 0;
+    for (size_t i = 0; i < num_tasks; ++i) {
+        step_cost[i] = estimator->get_work_estimate(steps[task_steps[i]].output);
+        if (step_cost[i] != 0) {
+            known_total += step_cost[i];
+            known_count++;
+        }
+    }
+    const size_t default_cost = known_count == 0 ? 1 : std::max<size_t>(1, known_total / known_count);
+    for (auto &cost : step_cost) {
+        if (cost == 0)
+            cost = default_cost;
+    }
+    return step_cost;
+}
+
+std::vector<size_t> Executor::compute_priorities(const BuildGraph::StepDag &dag,
+                                                 std::span<const size_t> step_cost) const {
+    const size_t num_tasks = step_cost.size();
+    if (config.schedule == SchedulePolicy::ESTIMATE) {
+        return {step_cost.begin(), step_cost.end()};
+    }
+
+    auto dependents = [&](size_t step) {
+        return std::span(dag.successors).subspan(dag.offsets[step], dag.offsets[step + 1] - dag.offsets[step]);
+    };
+
+    // Kahn's algorithm for a topological order. The graph was checked for cycles when it was
+    // loaded (`check_acyclic`); were one left, its steps would keep priority 0 and stall the scheduler.
+    std::vector<uint32_t> remaining(num_tasks, 0);
+    for (uint32_t succ : dag.successors)
+        remaining[succ]++;
+    std::vector<size_t> order;
+    order.reserve(num_tasks);
+    for (size_t i = 0; i < num_tasks; ++i) {
+        if (remaining[i] == 0)
+            order.push_back(i);
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+        for (uint32_t out : dependents(order[head])) {
+            if (--remaining[out] == 0)
+                order.push_back(out);
+        }
+    }
+
+    // Longest weighted path to a sink, accumulated in reverse topological order.
+    std::vector<size_t> priorities(num_tasks, 0);
+    for (size_t idx : std::views::reverse(order)) {
+        size_t longest_tail = 0;
+        for (uint32_t out : dependents(idx))
+            longest_tail = std::max(longest_tail, priorities[out]);
+        priorities[idx] = step_cost[idx] + longest_tail;
+    }
+    return priorities;
+}
+
+Executor::ResourcePlan Executor::plan_resources(const BuildGraph &graph, std::span<const uint32_t> task_steps) const {
+    const auto &steps = graph.steps();
+    const Pools &pools = builder.pools();
+    const bool budget = config.memory_budget_mib != 0;
+    if (!budget && pools.empty())
+        return {};
+
+    ResourcePlan plan;
+    // The budget is resource 0, so each task's demands come out sorted by resource.
+    std::vector<size_t> predicted;
+    if (budget) {
+        plan.capacities.push_back(config.memory_budget_mib * 1024);
+        predicted.resize(task_steps.size());
+        std::unordered_map<std::string_view, std::pair<size_t, size_t>> known_by_tool; // total, count
+        for (size_t i = 0; i < task_steps.size(); ++i) {
+            const auto &step = steps[task_steps[i]];
+            predicted[i] = rss_estimator->get_work_estimate(step.output);
+            if (predicted[i] != 0) {
+                auto &[total, count] = known_by_tool[step.tool];
+                total += predicted[i];
+                count++;
+            }
+        }
+        for (size_t i = 0; i < task_steps.size(); ++i) {
+            const auto &step = steps[task_steps[i]];
+            if (predicted[i] == 0) {
+                if (auto it = known_by_tool.find(step.tool); it != known_by_tool.end())
+                    predicted[i] = it->second.first / it->second.second;
+            }
+        }
+    }
+
+    std::unordered_map<std::string_view, uint32_t> pool_resource;
+    plan.offsets.reserve(task_steps.size() + 1);
+    plan.offsets.push_back(0);
+    for (size_t i = 0; i < task_steps.size(); ++i) {
+        const auto &step = steps[task_steps[i]];
+        if (budget && predicted[i] != 0)
+            plan.demands.push_back({.resource = 0, .amount = predicted[i]});
+        const std::string_view pool = step.pool.empty() ? step.tool : step.pool;
+        if (auto it = pools.find(pool); it != pools.end()) {
+            auto [slot, added] = pool_resource.try_emplace(pool, static_cast<uint32_t>(plan.capacities.size()));
+            if (added)
+                plan.capacities.push_back(it->second);
+            plan.demands.push_back({.resource = slot->second, .amount = 1});
+        }
+        plan.offsets.push_back(static_cast<uint32_t>(plan.demands.size()));
+    }
+    return plan;
 }
 
 Result<void> Executor::clean() {
@@ -68,43 +417,257 @@ Result<void> Executor::clean() {
     return {};
 }
 
-[[clang::always_inline]]
-bool inline Executor::needs_rebuild(const BuildStep &step, StatCache &stat_cache) const {
-    if (!std::filesystem::exists(step.output))
-        return true;
+Result<void> Executor::ingest_depfile(BuildState &state, size_t step_id, std::vector<std::string> *deps_out) const {
+    const auto &step = state.graph.steps()[step_id];
+    const std::filesystem::path depfile_path = std::format("{}.d", step.output);
+
+    // A compiler that wrote no .d file reported no dependencies.
+    std::vector<std::string_view> deps;
+    std::optional<MappedFile> map;
+    if (std::filesystem::exists(depfile_path)) {
+        try {
+            map.emplace(depfile_path);
+            parseDepfileContent(map->content(), [&deps](std::string_view dep) { deps.push_back(dep); });
+        } catch (const std::exception &err) {
+            // Left in place: the next graph construction parses it instead of the log.
+            state.depfiles_changed.store(true);
+            return std::unexpected(std::format("Failed to read {}: {}", depfile_path.string(), err.what()));
+        }
+    }
 
-    auto output_modtime = std::filesystem::last_write_time(step.output);
+    if (deps_out)
+        deps_out->assign(deps.begin(), deps.end());
+    if (state.graph.depfile_changed(step_id, deps))
+        state.depfiles_changed.store(true);
+    if (auto res = state.graph.deps_log().record(step.output, deps); !res)
+        return std::unexpected(std::format("Failed to record dependencies of {}: {}", step.output, res.error()));
+    map.reset();
+    std::error_code ec;
+    std::filesystem::remove(depfile_path, ec);
+    return {};
+}
 
-    if (stat_cache.changed_since(config.build_file, output_modtime)) {
-        return true;
+DirtyReason Executor::dirty_reason(const BuildGraph &graph,
+                                   const BuildStep &step,
+                                   StatCache &stat_cache,
+                                   bool check_depfile_inputs) const {
+    using enum DirtyReason::KIND;
+    const StatResult output_stat = stat_cache.get(step.output_node);
+    if (output_stat.ec)
+        return {.kind = MISSING_OUTPUT};
+
+    // The step's own command changed (or it was never recorded): rebuild regardless of mtimes.
+    if (build_log->command_hash(step.output) != command_hash(graph, step)) {
+        return {.kind = COMMAND_CHANGED};
     }
 
-    if (step.depfile_inputs.has_value()) {
-        for (const auto &dep : *step.depfile_inputs) {
-            if (stat_cache.changed_since(std::filesystem::path(dep), output_modtime)) {
-                return true;
+    // Explicit, opaque and depfile inputs alike (in that order); checking the explicit ones
+    // is also how we make sure that the .d file isn't stale.
+    std::span<const uint32_t> inputs = step.input_nodes;
+    if (!check_depfile_inputs)
+        inputs = inputs.first(inputs.size() - step.depfile_inputs.size());
+
+    // In --hash mode, mtimes only matter for steps built before their inputs were digested.
+    if (digest_cache) {
+        if (auto recorded = build_log->inputs_digest(step.output)) {
+            if (!check_depfile_inputs) {
+                // The digest covers the depfile inputs, so it is compared once they are statted.
+                auto missing =
+                    std::ranges::find_if(inputs, [&](uint32_t input) { return bool(stat_cache.get(input).ec); });
+                return missing == inputs.end() ? DirtyReason{} : DirtyReason{.kind = MISSING_INPUT, .node = *missing};
             }
+            return content_reason(graph, step, stat_cache, inputs, *recorded);
         }
     }
-    if (step.opaque_inputs.has_value()) {
-        for (const auto &opaque : *step.opaque_inputs) {
-            if (stat_cache.changed_since(std::filesystem::path(opaque), output_modtime)) {
-                return true;
+    return check_inputs(inputs, output_time(step, output_stat), stat_cache);
+}
+
+std::filesystem::file_time_type Executor::output_time(const BuildStep &step, const StatResult &output_stat) const {
+    if (!step.restat)
+        return output_stat.time;
+    return std::max(output_stat.time, build_log->built_at(step.output).value_or(output_stat.time));
+}
+
+DirtyReason Executor::content_reason(const BuildGraph &graph,
+                                     const BuildStep &step,
+                                     StatCache &stat_cache,
+                                     std::span<const uint32_t> inputs,
+                                     const Digest &recorded) const {
+    for (uint32_t input : inputs) {
+        if (stat_cache.get(input).ec)
+            return {.kind = DirtyReason::KIND::MISSING_INPUT, .node = input};
+    }
+    const auto explicit_inputs = step.input_nodes.first(step.input_nodes.size() - step.depfile_inputs.size());
+    InputSetDigest digest;
+    for (uint32_t input : explicit_inputs)
+        digest.add(graph.nodes()[input].path, stat_cache.digest(input));
+    for (uint32_t input : step.depfile_inputs) {
+        if (std::ranges::find(explicit_inputs, input) == explicit_inputs.end())
+            digest.add(graph.nodes()[input].path, stat_cache.digest(input));
+    }
+    if (digest.digest() != recorded)
+        return {.kind = DirtyReason::KIND::CHANGED_CONTENT};
+    return {};
+}
+
+Executor::BuildState::BuildState(BuildGraph &&graph, DigestCache *digests)
+    : graph(std::move(graph)), step_dag(this->graph.step_dag()), stat_cache(this->graph),
+      dirty(this->graph.steps().size()), task_of(this->graph.steps().size(), 0), scope(this->graph.steps().size()),
+      in_scope(this->graph.steps().size(), 1) {
+    std::iota(scope.begin(), scope.end(), 0);
+    if (digests)
+        stat_cache.enable_digests(*digests);
+}
+
+Result<void> Executor::select_targets(BuildState &state) const {
+    if (config.targets.empty())
+        return {};
+    auto steps = state.graph.steps_for_targets(config.targets);
+    if (!steps)
+        return std::unexpected(steps.error());
+    state.scope = std::move(*steps);
+    std::ranges::fill(state.in_scope, 0);
+    for (uint32_t step : state.scope)
+        state.in_scope[step] = 1;
+    return {};
+}
+
+std::vector<uint32_t> Executor::compute_dirty(BuildState &state) const {
+    const auto &graph = state.graph;
+    const auto &steps = graph.steps();
+    auto &reasons = state.dirty;
+
+    // Each check is a few array reads and a hash; threads only pay off on large graphs.
+    static constexpr size_t TUNABLE__dirty_steps_per_thread = 512;
+    auto check_all = [&](std::span<const uint32_t> ids, auto check) {
+        auto check_range = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                reasons[ids[i]] = check(steps[ids[i]]);
+        };
+        const size_t threads = std::clamp<size_t>(ids.size() / TUNABLE__dirty_steps_per_thread, 1, thread_count());
+        if (threads == 1) {
+            check_range(0, ids.size());
+        } else {
+            const size_t chunk = (ids.size() + threads - 1) / threads;
+            std::vector<std::jthread> pool;
+            pool.reserve(threads);
+            for (size_t begin = 0; begin < ids.size(); begin += chunk) {
+                pool.emplace_back(check_range, begin, std::min(ids.size(), begin + chunk));
             }
         }
+    };
+
+    // Stats are taken in two batches. Depfile inputs (mostly headers) are only statted for
+    // steps that pass every other check: a step whose output is missing, whose command
+    // changed or that has a newer explicit input rebuilds anyway, so on a clean build almost
+    // no header is statted. Entries from an earlier round (see `watch`) are dropped first.
+    state.stat_cache.reset();
+    std::vector<uint8_t> statted(graph.nodes().size(), 0);
+    std::vector<uint32_t> batch;
+    auto queue_stat = [&](uint32_t node) {
+        if (!statted[node]) {
+            statted[node] = 1;
+            batch.push_back(node);
+        }
+    };
+
+    for (uint32_t i : state.scope) {
+        queue_stat(steps[i].output_node);
+        const auto &inputs = steps[i].input_nodes;
+        std::ranges::for_each(inputs.first(inputs.size() - steps[i].depfile_inputs.size()), queue_stat);
     }
-    // this is our way of making sure that the .d file isn't stale
-    for (const auto &input : step.parsed_inputs) {
-        if (stat_cache.changed_since(input, output_modtime)) {
-            return true;
+    prefetch_stats(state.stat_cache, batch);
+    check_all(state.scope,
+              [&](const BuildStep &step) { return dirty_reason(graph, step, state.stat_cache, false); });
+
+    // In --hash mode, a step with a recorded digest is judged here by all of its inputs,
+    // which are hashed up front (in parallel) where their stat changed.
+    auto recorded_digest = [&](const BuildStep &step) {
+        return digest_cache ? build_log->inputs_digest(step.output) : std::nullopt;
+    };
+    batch.clear();
+    std::vector<uint32_t> recheck;
+    std::vector<uint32_t> digest_batch;
+    std::vector<uint8_t> digested(digest_cache ? graph.nodes().size() : 0, 0);
+    for (uint32_t i : state.scope) {
+        if (reasons[i].dirty())
+            continue;
+        const bool by_content = recorded_digest(steps[i]).has_value();
+        if (steps[i].depfile_inputs.empty() && !by_content)
+            continue;
+        recheck.push_back(i);
+        std::ranges::for_each(steps[i].depfile_inputs, queue_stat);
+        for (uint32_t input : by_content ? steps[i].input_nodes : std::span<const uint32_t>{}) {
+            if (!digested[input]) {
+                digested[input] = 1;
+                digest_batch.push_back(input);
+            }
         }
     }
-    return false;
+    prefetch_stats(state.stat_cache, batch);
+    if (!digest_batch.empty())
+        state.stat_cache.prefetch_digests(digest_batch, config.jobs);
+    check_all(recheck, [&](const BuildStep &step) {
+        if (auto recorded = recorded_digest(step))
+            return content_reason(graph, step, state.stat_cache, step.depfile_inputs, *recorded);
+        return check_inputs(
+            step.depfile_inputs, output_time(step, state.stat_cache.get(step.output_node)), state.stat_cache);
+    });
+
+    std::vector<uint32_t> dirty_steps;
+    for (uint32_t i : state.scope) {
+        if (reasons[i].dirty())
+            dirty_steps.push_back(i);
+    }
+    propagate_dirty(state, dirty_steps);
+    return dirty_steps;
+}
+
+void Executor::propagate_dirty(BuildState &state, std::vector<uint32_t> &dirty_steps) const {
+    const auto &dag = state.step_dag;
+    const auto &steps = state.graph.steps();
+    for (size_t head = 0; head < dirty_steps.size(); ++head) {
+        const uint32_t step = dirty_steps[head];
+        for (uint32_t i = dag.offsets[step]; i < dag.offsets[step + 1]; ++i) {
+            const uint32_t succ = dag.successors[i];
+            if (state.in_scope[succ] && !state.dirty[succ].dirty()) {
+                state.dirty[succ] = {.kind = DirtyReason::KIND::DIRTY_INPUT, .node = steps[step].output_node};
+                dirty_steps.push_back(succ);
+            }
+        }
+    }
+}
+
+void Executor::save_digests() const {
+    if (!digest_cache || config.dry_run)
+        return;
+    if (auto res = digest_cache->save(); !res)
+        std::println(stderr, "Failed to update content digests: {}", res.error());
+}
+
+size_t Executor::thread_count() const {
+    size_t count = config.jobs;
+    if (count == 0)
+        count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+void Executor::prefetch_stats(StatCache &stat_cache, std::span<const uint32_t> nodes) const {
+    if (nodes.empty())
+        return;
+    [[maybe_unused]] StatBatchReport report = stat_cache.prefetch(nodes, config.jobs);
+#if FF_cbe__profiling
+    std::println("Prefetched {} paths with {} syscalls{}",
+                 report.paths,
+                 report.syscalls,
+                 report.io_uring ? " (io_uring)" : "");
+#endif
 }
 
 Result<void> Executor::emit_graph() {
-    catalyst::BuildGraph build_graph = builder.emit_graph();
-    StatCache stat_cache;
+    BuildState state(builder.emit_graph(), digest_cache.get());
+    const BuildGraph &build_graph = state.graph;
+    compute_dirty(state);
 
     std::cout << "digraph catalyst_build {\n";
     std::cout << "  rankdir=LR;\n";
@@ -115,8 +678,7 @@ Result<void> Executor::emit_graph() {
         std::string color = "0.9 0.9 0.9"; // light gray for source files
 
         if (node.step_id.has_value()) {
-            const auto &step = build_graph.steps()[*node.step_id];
-            if (needs_rebuild(step, stat_cache)) {
+            if (state.dirty[*node.step_id].dirty()) {
                 color = "green";
             } else {
                 color = "white";
@@ -142,25 +704,6 @@ Result<void> Executor::emit_compdb() {
         order = *res;
     }
 
-    const auto &defs = builder.definitions();
-    auto get_def = [&](std::string_view key) -> std::string {
-        if (auto it = defs.find(key); it != defs.end())
-            return std::string(it->second);
-        return "";
-    };
-
-    // This __must__ be done otherwise optimizations will fuck up.
-    const std::string cc = get_def("cc");
-    const std::string cxx = get_def("cxx");
-    const std::string cxxflags = get_def("cxxflags");
-    const std::string cflags = get_def("cflags");
-
-    const std::vector cc_vec = std::ranges::views::split(cc, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector cxx_vec = std::ranges::views::split(cxx, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector cflags_vec = std::ranges::views::split(cflags, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector cxxflags_vec =
-        std::ranges::views::split(cxxflags, ' ') | std::ranges::to<std::vector<std::string>>();
-
     using json = nlohmann::json;
     json compdb = json::array();
     auto cwd = std::filesystem::current_path().string();
@@ -175,44 +718,13 @@ Result<void> Executor::emit_compdb() {
         if (step.tool != "cc" && step.tool != "cxx")
             continue;
 
-        const std::vector<std::string_view> &inputs = step.parsed_inputs;
-
-        std::vector<std::string> args;
-        auto add_parts = [&args](const auto &parts) {
-            for (const auto &part : parts) {
-                if (part.begin() != part.end()) {
-                    args.push_back(std::ranges::to<std::string>(part));
-                }
-            }
-        };
-
-        constexpr static size_t extra_md_reserves = 7;
-        if (step.tool == "cc") {
-            add_parts(cc_vec);
-            add_parts(cflags_vec);
-            args.reserve(args.size() + inputs.size() + extra_md_reserves);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        } else if (step.tool == "cxx") {
-            add_parts(cxx_vec);
-            add_parts(cxxflags_vec);
-            args.reserve(args.size() + inputs.size() + extra_md_reserves);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            args.reserve(args.size() + inputs.size());
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        }
+        std::vector<std::string> args = expand_command(build_graph, step);
 
         json entry;
         entry["directory"] = cwd;
         entry["arguments"] = args;
-        if (!inputs.empty()) {
-            entry["file"] = inputs[0];
+        if (!step.parsed_inputs.empty()) {
+            entry["file"] = build_graph.nodes()[step.parsed_inputs.front()].path;
         }
         entry["output"] = step.output;
         compdb.push_back(entry);
@@ -224,293 +736,396 @@ Result<void> Executor::emit_compdb() {
 }
 
 Result<void> Executor::execute() {
-    pool.clear(); // Ensure clean state
+    // Only steps are scheduled. Source files have nothing to run, so they are resolved here
+    // and never reach the pool.
+    BuildState state(builder.emit_graph(), digest_cache.get());
+    // Only dirty steps are scheduled, so a cycle of clean steps would otherwise go unnoticed.
+    if (auto res = state.graph.check_acyclic(state.step_dag); !res)
+        return res;
+    if (auto res = select_targets(state); !res)
+        return res;
 
-    catalyst::BuildGraph build_graph = builder.emit_graph();
+    // Decide what to run before anything runs.
+    std::vector<uint32_t> dirty_steps = compute_dirty(state);
 
-    const auto &defs = builder.definitions();
-    auto get_def = [&](std::string_view key) -> std::string {
-        if (auto it = defs.find(key); it != defs.end())
-            return std::string(it->second);
-        return "";
-    };
-
-    // This __must__ be done otherwise optimizations will fuck up.
-    const std::string cc = get_def("cc");
-    const std::string cxx = get_def("cxx");
-    const std::string cxxflags = get_def("cxxflags");
-    const std::string cflags = get_def("cflags");
-    const std::string ldflags = get_def("ldflags");
-    const std::string ldlibs = get_def("ldlibs");
-
-    const std::vector cc_vec = std::ranges::views::split(cc, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector cxx_vec = std::ranges::views::split(cxx, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector cflags_vec = std::ranges::views::split(cflags, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector cxxflags_vec =
-        std::ranges::views::split(cxxflags, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector ldflags_vec =
-        std::ranges::views::split(ldflags, ' ') | std::ranges::to<std::vector<std::string>>();
-    const std::vector ldlibs_vec = std::ranges::views::split(ldlibs, ' ') | std::ranges::to<std::vector<std::string>>();
-
-    // Build in-degrees
-    std::vector<int> in_degrees(build_graph.nodes().size(), 0);
-    for (const auto &node : build_graph.nodes()) {
-        for (size_t out : node.out_edges) {
-            in_degrees[out]++;
-        }
-    }
-
-    struct Task {
-        size_t node_idx;
-        size_t estimate;
-        bool operator<(const Task &other) const {
-            return estimate < other.estimate;
+#if FF_cbe__logging
+    for (uint32_t i : state.scope) {
+        if (!state.dirty[i].dirty()) {
+            std::println("Skipping {} (up to date)", state.graph.steps()[i].output);
         }
-    };
-    std::priority_queue<Task> ready_queue;
+    }
+#endif
 
-    auto push_ready = [&](size_t idx) {
-        size_t est = 0;
-        const auto &node = build_graph.nodes()[idx];
-        if (node.step_id.has_value()) {
-            est = estimator->get_work_estimate(build_graph.steps()[*node.step_id].output);
-        }
-        ready_queue.push({.node_idx = idx, .estimate = est});
-    };
+    return run_dirty(state, std::move(dirty_steps));
+}
 
-    for (size_t i = 0; i < in_degrees.size(); ++i) {
-        if (in_degrees[i] == 0) {
-            push_ready(i);
+Result<void> Executor::run_dirty(BuildState &state, std::vector<uint32_t> dirty_steps) {
+    const BuildGraph &build_graph = state.graph;
+
+    // Nothing to do: no log, no workers. Files rehashed by the dirty check are still worth keeping.
+    if (dirty_steps.empty()) {
+        save_digests();
+        return {};
+    }
+
+    // Step order keeps the explain output and the task numbering deterministic.
+    std::ranges::sort(dirty_steps);
+    if (config.explain) {
+        for (uint32_t step : dirty_steps) {
+            std::println(
+                stderr, "explain: {}: {}", build_graph.steps()[step].output, describe(build_graph, state.dirty[step]));
         }
     }
 
-    std::mutex mtx;
-    std::condition_variable cv_ready;
-    std::atomic<size_t> completed_count = 0;
-    size_t total_nodes = build_graph.nodes().size();
-    bool error_occurred = false;
-    size_t active_workers = 0;
+    const std::vector<uint32_t> &task_steps = dirty_steps;
+    const BuildGraph::StepDag task_dag = dirty_subdag(state.step_dag, task_steps, state.in_scope, state.task_of);
+
+    if (!config.dry_run) {
+        if (auto res = build_log->open_for_append(); !res)
+            return std::unexpected(res.error());
+        if (auto res = state.graph.deps_log().open_for_append(); !res)
+            return std::unexpected(res.error());
+    }
+
+    // Resolved once up front so the scheduler never touches the estimator while running.
+    const std::vector<size_t> costs = task_costs(build_graph, task_steps);
+    const std::vector<size_t> priorities = compute_priorities(task_dag, costs);
+    const ResourcePlan resources = plan_resources(build_graph, task_steps);
 
-    StatCache stat_cache;
+    // Share the job budget of an outer make, or offer ours to the tools the steps run.
+    std::unique_ptr<Jobserver> jobserver;
+    if (config.jobserver && !config.dry_run) {
+        jobserver = Jobserver::from_environment();
+        if (!jobserver) {
+            if (auto created = Jobserver::create(thread_count()))
+                jobserver = std::move(*created);
+            else
+                std::println(stderr, "Not providing a jobserver: {}", created.error());
+        }
+    }
 
-#ifdef _WIN32
-    std::ofstream tty("CON");
-#elifdef _WIN64
-    std::ofstream tty("CON");
-#elifdef __linux__
-    std::ofstream tty("/dev/tty");
+#ifdef __linux__
+    // Keys, (de)compression, input digests and restat hashing would all run on the reactor's one
+    // thread, one step at a time, so builds that do any of them run their steps on workers.
+    const bool hashes = artifact_cache || digest_cache || std::ranges::any_of(task_steps, [&](uint32_t step) {
+                            return build_graph.steps()[step].restat;
+                        });
+    const bool use_reactor = pidfd_supported() && !hashes;
+#else
+    const bool use_reactor = false;
 #endif
-    std::mutex cout_tty_mtx;
+    // The reactor runs on this thread alone, so it needs a single queue.
+    Scheduler scheduler({.offsets = task_dag.offsets, .successors = task_dag.successors, .priorities = priorities},
+                        use_reactor ? 1 : thread_count(),
+                        resources.view());
+    // All progress output goes through here; the steps themselves never wait on a stream.
+    const size_t total_cost = std::accumulate(costs.begin(), costs.end(), size_t{0});
+#ifdef __linux__
+    const Renderer::Mode mode = Renderer::detect_mode();
+#else
+    // The steps write straight to the terminal here, which would garble a status line.
+    const Renderer::Mode mode = Renderer::Mode::LINES;
+#endif
+    Renderer renderer(mode, scheduler.total(), total_cost, config.dry_run);
+    // A status line is redrawn in place, so what the steps print must go through the renderer too.
+    const bool capture_output = mode == Renderer::Mode::STATUS && !config.dry_run;
 
-    // If graph is empty
-    if (total_nodes == 0)
-        return {};
+    // When each task started, for the duration recorded in the work estimates.
+    std::vector<std::chrono::steady_clock::time_point> started(task_steps.size());
+    // Artifact cache key of each task that has one, and whether it was restored rather than run.
+    std::vector<std::optional<Digest>> cache_keys(task_steps.size());
+    std::vector<uint8_t> restored(task_steps.size(), 0);
+    const size_t cache_hits = artifact_cache ? artifact_cache->hits() : 0;
+    const size_t cache_misses = artifact_cache ? artifact_cache->misses() : 0;
+    // For `restat` tasks, the output as it was before the task ran.
+    struct PreviousOutput {
+        std::optional<Digest> digest;
+        std::filesystem::file_time_type time;
+    };
+    std::vector<std::optional<PreviousOutput>> previous_outputs(task_steps.size());
+    // Set by a finished task on each dependent task, unless it left its output byte-identical.
+    std::vector<std::atomic<bool>> inputs_changed(task_steps.size());
+    auto depfile_of = [](const BuildStep &step) -> std::optional<std::filesystem::path> {
+        if (step.tool == "cc" || step.tool == "cxx")
+            return std::format("{}.d", step.output);
+        return std::nullopt;
+    };
 
-    auto process_step = [&](size_t node_idx) {
-        // NOLINTBEGIN(performance-avoid-endl)
-        const auto &node = build_graph.nodes()[node_idx];
-        if (node.step_id.has_value()) {
-            const auto &step = build_graph.steps()[*node.step_id];
-            const auto &inputs = step.parsed_inputs;
-
-            if (needs_rebuild(step, stat_cache)) {
-                {
-                    std::lock_guard lock(cout_tty_mtx);
-                    tty << "\033[1m" << std::flush;
-                    if (config.dry_run)
-                        std::cout << "[DRY RUN] " << std::flush;
-                    else
-                        std::cout << "[" << completed_count + 1 << "/" << total_nodes << "] " << std::flush;
-                    tty << "\033[0m\033[1;32m" << std::flush;
-                    std::cout << std::setw(3) << step.tool << std::flush;
-                    tty << "\033[0m\033[0m" << std::flush;
-                    std::cout << " -> " << step.output << std::endl;
-                    if (config.dry_run)
-                        return 0;
-                }
+    // Reports the step and returns the command to run, or nothing for a dry run.
+    auto prepare_step = [&](uint32_t task) -> std::optional<std::vector<std::string>> {
+        const auto &step = build_graph.steps()[task_steps[task]];
+        const auto &inputs = step.parsed_inputs;
+        renderer.started(step.tool, step.output);
+        if (config.dry_run)
+            return std::nullopt;
 
-                static constexpr auto ARGS_VEC_INIT_SZ = 40;
-                std::vector<std::string> args;
-                args.reserve(ARGS_VEC_INIT_SZ);
-                auto add_parts = [&args](const auto &parts) {
-                    args.reserve(args.size() + parts.size());
-                    for (const auto &part : parts) {
-                        if (part.begin() != part.end()) {
-                            args.push_back(std::ranges::to<std::string>(part));
-                        }
-                    }
-                };
-
-                if (step.tool == "cc") {
-                    add_parts(cc_vec);
-                    add_parts(cflags_vec);
-                    args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-                    for (const auto &in : inputs)
-                        args.emplace_back(in);
-                    args.emplace_back("-o");
-                    args.emplace_back(step.output);
-                } else if (step.tool == "cxx") {
-                    add_parts(cxx_vec);
-                    add_parts(cxxflags_vec);
-                    args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-                    for (const auto &in : inputs)
-                        args.emplace_back(in);
-                    args.emplace_back("-o");
-                    args.emplace_back(step.output);
-                } else if (step.tool == "ld") {
-                    add_parts(cxx_vec);
-                    static constexpr auto TUNABLE__INPUT_SZ = 50;
-                    std::filesystem::path rsp_path = std::filesystem::path(step.output).replace_extension(".rsp");
-                    if (std::filesystem::exists(rsp_path) && isNewer(rsp_path, config.build_file)) {
-                        args.push_back(std::string("@") + rsp_path.string());
-                    } else if (inputs.size() > TUNABLE__INPUT_SZ) {
-                        std::string rsp_content;
-                        constexpr auto TUNABLE__rsp_path_estimate = 100;
-                        rsp_content.reserve(inputs.size() * TUNABLE__rsp_path_estimate);
-                        for (const auto &input : inputs) {
-                            rsp_content += input;
-                            rsp_content += '\n';
-                        }
-                        std::ofstream rsp_file(rsp_path);
-                        rsp_file.write(rsp_content.data(), rsp_content.size());
-                        args.push_back(std::string("@") + rsp_path.string());
-                    } else {
-                        for (const auto &in : inputs)
-                            args.emplace_back(in);
-                    }
-                    args.emplace_back("-o");
-                    args.emplace_back(step.output);
-                    add_parts(ldflags_vec);
-                    add_parts(ldlibs_vec);
-                } else if (step.tool == "ar") {
-                    args.insert(args.end(), {"ar", "rcs", std::string(step.output)});
-                    for (const auto &in : inputs)
-                        args.emplace_back(in);
-                } else if (step.tool == "sld") {
-                    add_parts(cxx_vec);
-                    args.emplace_back("-shared");
-                    for (const auto &in : inputs)
-                        args.emplace_back(in);
-                    args.emplace_back("-o");
-                    args.emplace_back(step.output);
+        // The inputs the step is known to read are digested before it runs and kept in the stat
+        // cache, so an edit saved while it runs is not recorded as what it was built from.
+        if (digest_cache) {
+            for (uint32_t input : step.input_nodes)
+                state.stat_cache.digest(input);
+        }
+        if (step.restat) {
+            if (const StatResult output_stat = state.stat_cache.get(step.output_node); !output_stat.ec) {
+                previous_outputs[task] = PreviousOutput{
+                    .digest = digest_cache ? state.stat_cache.digest(step.output_node) : file_digest(step.output),
+                    .time = output_stat.time};
+            }
+        }
+
+        std::optional<std::string> rsp_file;
+        if (step.tool == "ld") {
+            static constexpr auto TUNABLE__INPUT_SZ = 50;
+            std::filesystem::path rsp_path = std::filesystem::path(step.output).replace_extension(".rsp");
+            if (std::filesystem::exists(rsp_path) && isNewer(rsp_path, config.build_file)) {
+                rsp_file = rsp_path.string();
+            } else if (inputs.size() > TUNABLE__INPUT_SZ) {
+                std::string rsp_content;
+                constexpr auto TUNABLE__rsp_path_estimate = 100;
+                rsp_content.reserve(inputs.size() * TUNABLE__rsp_path_estimate);
+                for (uint32_t input : inputs) {
+                    rsp_content += build_graph.nodes()[input].path;
+                    rsp_content += '\n';
                 }
+                std::ofstream rsp_stream(rsp_path);
+                rsp_stream.write(rsp_content.data(), rsp_content.size());
+                rsp_file = rsp_path.string();
+            }
+        }
+        started[task] = std::chrono::steady_clock::now();
+        return expand_command(build_graph, step, rsp_file);
+    };
 
-#if FF_cbe__profiling
-                auto start = std::chrono::steady_clock::now();
+    // In --hash mode, the digest of the inputs the step was built from. Known inputs were digested
+    // by `prepare_step`; only those its depfile lists for the first time are digested now (the
+    // graph learns about them on the next parse).
+    auto built_inputs_digest = [&](const BuildStep &step, std::span<const std::string> fresh_deps) {
+        const auto &nodes = step.input_nodes;
+        std::vector<std::string_view> explicit_paths;
+        InputSetDigest digest;
+        for (uint32_t input : nodes.first(nodes.size() - step.depfile_inputs.size())) {
+            explicit_paths.push_back(build_graph.nodes()[input].path);
+            digest.add(explicit_paths.back(), state.stat_cache.digest(input));
+        }
+        for (const auto &dep : fresh_deps) {
+            if (std::ranges::find(explicit_paths, dep) != explicit_paths.end())
+                continue;
+            auto node = build_graph.find_node(dep);
+            digest.add(dep,
+                       node ? state.stat_cache.digest(static_cast<uint32_t>(*node))
+                            : digest_cache->digest(dep, stat_one(dep)));
+        }
+        return digest.digest();
+    };
+
+    // A task that is only dirty because of its inputs is skipped once none of them changed after all.
+    auto cut_off = [&](uint32_t task) {
+        const uint32_t step_id = task_steps[task];
+        if (config.dry_run || state.dirty[step_id].kind != DirtyReason::KIND::DIRTY_INPUT ||
+            inputs_changed[task].load(std::memory_order_relaxed))
+            return false;
+        const auto &step = build_graph.steps()[step_id];
+        if (config.explain)
+            renderer.message(std::format("explain: {}: skipped, its rebuilt inputs are unchanged", step.output));
+        renderer.skipped(step.tool, step.output, costs[task]);
+        state.dirty[step_id] = {};
+        return true;
+    };
+
+    // Restores the step's output (and depfile) from the artifact cache instead of running it.
+    auto restore_step = [&](uint32_t task) {
+        if (!artifact_cache)
+            return false;
+        const auto &step = build_graph.steps()[task_steps[task]];
+        cache_keys[task] = artifact_key(build_graph, step);
+        restored[task] = cache_keys[task] && artifact_cache->restore(*cache_keys[task], step.output, depfile_of(step));
+        return restored[task] != 0;
+    };
+
+#ifdef __linux__
+    auto spawn_step = [&](std::vector<std::string> &&args) {
+        return process_spawn(std::move(args), std::nullopt, std::nullopt, capture_output);
+    };
+    // Waits for a step's command and prints what it wrote, if that was captured.
+    auto wait_step = [&](ChildProcess &child) {
+        auto res = process_wait(child);
+        if (!child.output.empty()) {
+            if (child.output.ends_with('\n'))
+                child.output.pop_back();
+            renderer.message(std::move(child.output));
+        }
+        return res;
+    };
 #endif
-                auto res = catalyst::process_exec(std::move(args));
+
+    // Records the outcome of a step's command; false if it failed.
+    auto finish_step = [&](uint32_t task, const Result<int> &res, size_t peak_rss_kib = 0) {
+        const uint32_t step_id = task_steps[task];
+        const auto &step = build_graph.steps()[step_id];
+        auto elapsed = std::chrono::steady_clock::now() - started[task];
+        renderer.finished(costs[task], res && *res == 0);
 #if FF_cbe__profiling
-                auto end = std::chrono::steady_clock::now();
-                std::chrono::duration<double> diff = end - start;
-                {
-                    std::lock_guard lock(cout_tty_mtx);
-                    std::println("Step {} took {:.4f}s", step.output, diff.count());
-                }
+        renderer.message(
+            std::format("Step {} took {:.4f}s", step.output, std::chrono::duration<double>(elapsed).count()));
 #endif
 
-                if (res) {
-                    int ec = *res;
-                    if (ec != 0) {
-                        std::println(stderr, "Build failed: {} -> {} (exit code {})", step.tool, step.output, ec);
-                        return ec;
-                    }
-                } else {
-                    std::println(stderr, "Failed to execute: {}", res.error());
-                    return 1;
-                }
-            }
-#if FF_cbe__logging
-            else {
-                std::lock_guard lock(cout_tty_mtx);
-                std::println("Skipping {} (up to date)", step.output);
+        if (!res) {
+            renderer.message(std::format("Failed to execute: {}", res.error()), true);
+            return false;
+        }
+        if (*res != 0) {
+            renderer.message(std::format("Build failed: {} -> {} (exit code {})", step.tool, step.output, *res), true);
+            return false;
+        }
+        // Keep the table in sync with the new output.
+        state.stat_cache.refresh(step.output_node);
+        // A byte-identical `restat` output gets its old mtime back, so its dependents stay clean;
+        // the log remembers when it was actually built.
+        std::optional<std::filesystem::file_time_type> built_at;
+        if (const auto &previous = previous_outputs[task];
+            previous && previous->digest && file_digest(step.output) == previous->digest) {
+            std::error_code ec;
+            const auto built_time = state.stat_cache.get(step.output_node).time;
+            std::filesystem::last_write_time(step.output, previous->time, ec);
+            if (!ec) {
+                built_at = built_time;
+                state.stat_cache.refresh(step.output_node);
             }
-#endif
         }
-        return 0;
-        // NOLINTEND(performance-avoid-endl)
+        if (!built_at) {
+            for (uint32_t i = task_dag.offsets[task]; i < task_dag.offsets[task + 1]; ++i)
+                inputs_changed[task_dag.successors[i]].store(true, std::memory_order_relaxed);
+        }
+        // Stored before the depfile is ingested (and deleted).
+        if (cache_keys[task] && !restored[task]) {
+            if (auto res = artifact_cache->store(*cache_keys[task], step.output, depfile_of(step)); !res)
+                renderer.message(std::format("Failed to cache {}: {}", step.output, res.error()), true);
+        }
+        std::vector<std::string> deps;
+        if (step.tool == "cc" || step.tool == "cxx") {
+            if (auto res = ingest_depfile(state, step_id, digest_cache ? &deps : nullptr); !res)
+                renderer.message(res.error(), true);
+        }
+        std::optional<Digest> digest;
+        if (digest_cache)
+            digest = built_inputs_digest(step, deps);
+        build_log->record(
+            step.output,
+            {.command_hash = command_hash(build_graph, step), .inputs_digest = digest, .built_at = built_at});
+        // A restored step says nothing about how long running it takes, or how much memory.
+        if (!restored[task]) {
+            estimator->record(step.output, std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+            if (peak_rss_kib != 0)
+                rss_estimator->record(step.output, peak_rss_kib);
+        }
+        state.dirty[step_id] = {};
+        return true;
     };
 
-    auto worker = [&]() {
-        while (true) {
-            size_t node_idx;
-            {
-                std::unique_lock lock(mtx);
-                cv_ready.wait(lock, [&] {
-                    return !ready_queue.empty() || completed_count == total_nodes || active_workers == 0; //
-                });
-
-                if (ready_queue.empty()) {
-                    if (completed_count == total_nodes)
-                        return;
-                    // If queue is empty and no active workers, but work not done -> Cycle
-                    return;
-                }
-
-                node_idx = ready_queue.top().node_idx;
-                ready_queue.pop();
-                active_workers++;
-            }
-
-            int result = process_step(node_idx);
-
-            {
-                std::lock_guard lock(mtx);
-                active_workers--;
-
-                size_t new_work_count = 0;
-
-                if (result != 0) {
-                    error_occurred = true;
-                    completed_count = total_nodes; // Force exit
-                } else {
-                    completed_count.fetch_add(1, std::memory_order_relaxed);
-                    const auto &node = build_graph.nodes()[node_idx];
-                    for (size_t neighbor : node.out_edges) {
-                        in_degrees[neighbor]--;
-                        if (in_degrees[neighbor] == 0) {
-                            push_ready(neighbor);
-                            new_work_count++;
-                        }
-                    }
-                }
+    auto run_step = [&](uint32_t task) {
+        if (cut_off(task))
+            return true;
+        auto args = prepare_step(task);
+        if (!args) {
+            state.dirty[task_steps[task]] = {};
+            return true;
+        }
+        if (restore_step(task))
+            return finish_step(task, 0);
+#ifdef __linux__
+        auto child = spawn_step(std::move(*args));
+        if (!child)
+            return finish_step(task, std::unexpected(child.error()));
+        auto res = wait_step(*child);
+        return finish_step(task, res, child->peak_rss_kib);
+#else
+        return finish_step(task, process_exec(std::move(*args)));
+#endif
+    };
 
-                bool build_finished = (completed_count == total_nodes);
-                bool stall_detected = (active_workers == 0);
-                constexpr auto TUNABLE__notify_all_criteria = 10;
-                if (build_finished || error_occurred || stall_detected) {
-                    cv_ready.notify_all();
-                } else if (new_work_count == 1) {
-                    cv_ready.notify_one();
-                } else if (new_work_count >= TUNABLE__notify_all_criteria) {
-                    cv_ready.notify_all();
-                } else {
-                    for (size_t ii = 0; ii < new_work_count; ++ii) {
-                        cv_ready.notify_one();
-                    }
+    auto run_threaded = [&] {
+        // One step at a time runs in our implicit jobserver slot; the others hold a token.
+        std::atomic<bool> implicit_slot = true;
+        return scheduler.run([&](uint32_t task) {
+            if (!jobserver)
+                return run_step(task);
+            const bool implicit = implicit_slot.exchange(false);
+            if (!implicit) {
+                if (auto res = jobserver->acquire(); !res) {
+                    renderer.message(std::format("Failed to execute: {}", res.error()), true);
+                    return false;
                 }
             }
-        }
+            const bool ok = run_step(task);
+            if (implicit)
+                implicit_slot.store(true);
+            else
+                jobserver->release();
+            return ok;
+        });
     };
 
-    size_t thread_count = config.jobs;
-    if (thread_count == 0)
-        thread_count = std::thread::hardware_concurrency();
-    if (thread_count == 0)
-        thread_count = 1;
-
-    for (size_t i = 0; i < thread_count; ++i) {
-        pool.emplace_back(worker);
+#ifdef __linux__
+    Result<void> res;
+    if (use_reactor) {
+        // One thread starts every command and waits on their pidfds, however many run at once.
+        std::vector<ChildProcess> children(task_steps.size());
+        auto start = [&](uint32_t task) -> Scheduler::Started {
+            if (cut_off(task))
+                return {};
+            auto args = prepare_step(task);
+            if (!args) {
+                state.dirty[task_steps[task]] = {};
+                return {};
+            }
+            if (restore_step(task))
+                return {.ok = finish_step(task, 0)};
+            auto child = spawn_step(std::move(*args));
+            if (!child)
+                return {.ok = finish_step(task, std::unexpected(child.error()))};
+            children[task] = *child;
+            if (child->pidfd < 0) {
+                auto res = wait_step(children[task]);
+                return {.ok = finish_step(task, res, children[task].peak_rss_kib)};
+            }
+            return {.fd = child->pidfd};
+        };
+        auto finish = [&](uint32_t task) {
+            auto res = wait_step(children[task]);
+            return finish_step(task, res, children[task].peak_rss_kib);
+        };
+        res = scheduler.run_reactor(thread_count(), start, finish, jobserver.get());
+    } else {
+        res = run_threaded();
     }
+#else
+    Result<void> res = run_threaded();
+#endif
+    renderer.stop();
 
-    pool.clear(); // Join all threads
-
-    if (error_occurred)
-        return std::unexpected("Build Failed");
+    if (artifact_cache && !config.dry_run) {
+        std::println("Artifact cache: {} hits, {} misses",
+                     artifact_cache->hits() - cache_hits,
+                     artifact_cache->misses() - cache_misses);
+        artifact_cache->trim();
+    }
 
-    if (completed_count != total_nodes)
-        return std::unexpected("Cycle detected: Build stalled with pending nodes.");
+    if (!config.dry_run) {
+        if (auto res = estimator->save(); !res) {
+            std::println(stderr, "Failed to update work estimates: {}", res.error());
+        }
+        if (auto res = rss_estimator->save(); !res) {
+            std::println(stderr, "Failed to update memory estimates: {}", res.error());
+        }
+    }
+    save_digests();
+#if FF_cbe__binary
+    // The cached graph baked in the old depfile edges.
+    if (state.depfiles_changed.load())
+        invalidate_bin();
+#endif
 
-    return {};
+    return res;
 }
 
 } // namespace catalyst
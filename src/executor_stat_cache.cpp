@@ -1,41 +1,105 @@
+#include "cbe/digest_cache.hpp"
 #include "cbe/executor.hpp"
+#include "cbe/stat_batch.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
 using namespace catalyst;
 
-bool StatCache::Entry::operator<(const Entry &other) const {
-    return path < other.path;
-}
-bool StatCache::Entry::operator<(const std::filesystem::path &other_path) const {
-    return path < other_path;
+StatCache::StatCache(const BuildGraph &graph)
+    : graph(graph), results(std::make_unique<StatResult[]>(graph.nodes().size())),
+      state(std::make_unique<std::atomic<SLOT>[]>(graph.nodes().size())) {}
+
+StatResult StatCache::get(uint32_t node) {
+    if (state[node].load(std::memory_order_acquire) == SLOT::READY)
+        return results[node];
+
+    // Slow path: only reached for nodes the prefetch did not cover.
+    StatResult res = stat_one(graph.nodes()[node].path);
+    SLOT expected = SLOT::EMPTY;
+    if (state[node].compare_exchange_strong(expected, SLOT::COMPUTING, std::memory_order_acquire)) {
+        results[node] = res;
+        state[node].store(SLOT::READY, std::memory_order_release);
+    }
+    // Losing the race is harmless: the winner publishes an equivalent result.
+    return res;
 }
 
-auto StatCache::get_or_update(const std::filesystem::path &p)
-    -> std::pair<std::filesystem::file_time_type, std::error_code> {
-    auto is_path_less = [](const Entry &e, const std::filesystem::path &val) { return e.path < val; };
-    {
-        std::shared_lock read_lock(cache_mtx);
+StatBatchReport StatCache::prefetch(std::span<const uint32_t> nodes, size_t threads) {
+    std::vector<std::string_view> paths;
+    paths.reserve(nodes.size());
+    for (uint32_t node : nodes)
+        paths.push_back(graph.nodes()[node].path);
 
-        auto it = std::lower_bound(cache.begin(), cache.end(), p, is_path_less);
+    StatBatchReport report;
+    std::vector<StatResult> batch = stat_batch(paths, threads, &report);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        results[nodes[i]] = batch[i];
+        state[nodes[i]].store(SLOT::READY, std::memory_order_release);
+    }
+    return report;
+}
 
-        if (it != cache.end() && it->path == p) {
-            return {it->time, it->ec};
-        }
+void StatCache::prefetch_digests(std::span<const uint32_t> nodes, size_t threads) {
+    // Mostly table lookups; a file is only read when its stat changed, and then hashing it
+    // dominates. Either way, a thread only pays off for a sizable share of the batch.
+    static constexpr size_t TUNABLE__digests_per_thread = 256;
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::clamp<size_t>(nodes.size() / TUNABLE__digests_per_thread, 1, std::max<size_t>(threads, 1));
+    if (threads == 1) {
+        for (uint32_t node : nodes)
+            digest(node);
+        return;
+    }
+    std::vector<std::jthread> pool;
+    pool.reserve(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            for (size_t i = t; i < nodes.size(); i += threads)
+                digest(nodes[i]);
+        });
     }
+}
+
+void StatCache::enable_digests(DigestCache &digests) {
+    this->digests = &digests;
+    digest_results = std::make_unique<std::optional<Digest>[]>(graph.nodes().size());
+    digest_state = std::make_unique<std::atomic<SLOT>[]>(graph.nodes().size());
+}
 
-    std::lock_guard write_lock(cache_mtx);
-    auto it = std::lower_bound(cache.begin(), cache.end(), p, is_path_less);
-    std::error_code ec;
-    auto time = std::filesystem::last_write_time(p, ec);
+std::optional<Digest> StatCache::digest(uint32_t node) {
+    if (digest_state[node].load(std::memory_order_acquire) == SLOT::READY)
+        return digest_results[node];
 
-    cache.insert(it, {p, time, ec}); // it is the element right below so we can add here safely
-    return {time, ec};
+    std::optional<Digest> res = digests->digest(graph.nodes()[node].path, get(node));
+    SLOT expected = SLOT::EMPTY;
+    if (digest_state[node].compare_exchange_strong(expected, SLOT::COMPUTING, std::memory_order_acquire)) {
+        digest_results[node] = res;
+        digest_state[node].store(SLOT::READY, std::memory_order_release);
+    }
+    return res;
+}
+
+void StatCache::reset() {
+    for (size_t i = 0; i < graph.nodes().size(); ++i) {
+        state[i].store(SLOT::EMPTY, std::memory_order_relaxed);
+        if (digests)
+            digest_state[i].store(SLOT::EMPTY, std::memory_order_relaxed);
+    }
 }
 
-bool StatCache::changed_since(const std::filesystem::path &input, std::filesystem::file_time_type output_time) {
-    auto [input_time, ec] = get_or_update(input);
-    if (ec)
-        return true; // If input missing/error, assume rebuild needed
-    return input_time >= output_time;
+void StatCache::refresh(uint32_t node) {
+    results[node] = stat_one(graph.nodes()[node].path);
+    state[node].store(SLOT::READY, std::memory_order_release);
+    if (digests)
+        digest_state[node].store(SLOT::EMPTY, std::memory_order_release);
 }
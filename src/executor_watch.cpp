@@ -0,0 +1,238 @@
+#include "cbe/executor.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <print>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace catalyst {
+
+#ifdef __linux__
+namespace {
+
+/** @brief Owns an inotify descriptor and reports changed files spelled like graph nodes. */
+class DirWatcher {
+public:
+    static constexpr int TUNABLE__debounce_ms = 50;
+
+    struct Changes {
+        std::vector<std::string> paths;
+        bool overflowed = false; ///< Events were dropped; everything must be re-checked.
+    };
+
+    DirWatcher() : fd_(inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) {}
+    ~DirWatcher() {
+        if (fd_ != -1)
+            close(fd_);
+    }
+
+    DirWatcher(const DirWatcher &) = delete;
+    DirWatcher &operator=(const DirWatcher &) = delete;
+
+    bool ok() const {
+        return fd_ != -1;
+    }
+
+    /**
+     * @brief Watches a directory. Directories that do not exist (yet) are remembered for `rearm`,
+     * and their parent is watched instead, so that creating them wakes `wait_for_changes`.
+     * @return An error only if the kernel ran out of watches.
+     */
+    Result<void> add(std::string_view dir) {
+        auto res = try_add(dir);
+        if (!res)
+            return std::unexpected(res.error());
+        if (*res)
+            return {};
+        missing_.emplace_back(dir);
+        return dir.empty() ? Result<void>{} : add(parent_dir(dir));
+    }
+
+    /**
+     * @brief Retries the directories that were missing when they were added.
+     * @return Whether any of them is watched now, or an error if the kernel ran out of watches.
+     */
+    Result<bool> rearm() {
+        bool armed = false;
+        for (auto it = missing_.begin(); it != missing_.end();) {
+            auto res = try_add(*it);
+            if (!res)
+                return std::unexpected(res.error());
+            armed |= *res;
+            it = *res ? missing_.erase(it) : it + 1;
+        }
+        return armed;
+    }
+
+    /**
+     * @brief Blocks until something changes, then keeps collecting until the watched
+     * directories have been quiet for `TUNABLE__debounce_ms`, so a save that touches
+     * several files triggers one rebuild.
+     */
+    Changes wait_for_changes() {
+        Changes changes;
+        int timeout = -1;
+        for (;;) {
+            pollfd pfd{.fd = fd_, .events = POLLIN, .revents = 0};
+            int ready = poll(&pfd, 1, timeout);
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready <= 0)
+                break;
+            drain(changes);
+            timeout = TUNABLE__debounce_ms;
+        }
+        return changes;
+    }
+
+private:
+    /** @return Whether the directory is watched now (false if it does not exist). */
+    Result<bool> try_add(std::string_view dir) {
+        std::string path(dir.empty() ? "." : dir);
+        int wd = inotify_add_watch(fd_,
+                                   path.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB);
+        if (wd == -1) {
+            if (errno == ENOSPC) {
+                return std::unexpected(std::format(
+                    "Out of inotify watches while watching {} (raise fs.inotify.max_user_watches)", path));
+            }
+            return false;
+        }
+        // Changed files are reported as `prefix + name`, spelled like graph nodes.
+        dirs_.emplace(wd, dir.empty() || dir.ends_with('/') ? std::string(dir) : std::format("{}/", dir));
+        return true;
+    }
+
+    void drain(Changes &changes) {
+        alignas(inotify_event) char buf[16 * 1024];
+        for (;;) {
+            ssize_t len = read(fd_, buf, sizeof(buf));
+            if (len <= 0)
+                return;
+            for (ssize_t off = 0; off < len;) {
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                const auto *event = reinterpret_cast<const inotify_event *>(buf + off);
+                off += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                    changes.overflowed = true;
+                    continue;
+                }
+                auto it = dirs_.find(event->wd);
+                if (it == dirs_.end() || event->len == 0)
+                    continue;
+                changes.paths.push_back(it->second + event->name);
+            }
+        }
+    }
+
+    int fd_;
+    std::unordered_map<int, std::string> dirs_; ///< Watch descriptor to the prefix of its files.
+    std::vector<std::string> missing_;
+};
+
+} // namespace
+#endif
+
+Result<void> Executor::watch() {
+#ifndef __linux__
+    return std::unexpected("--watch is only supported on Linux");
+#else
+    BuildState state(builder.emit_graph(), digest_cache.get());
+    if (auto res = state.graph.check_acyclic(state.step_dag); !res)
+        return res;
+    if (auto res = select_targets(state); !res)
+        return res;
+    const auto &nodes = state.graph.nodes();
+
+    DirWatcher watcher;
+    if (!watcher.ok()) {
+        return std::unexpected(std::format("Failed to initialize inotify: {}", std::strerror(errno)));
+    }
+    // Produced files are not watched on their own; they live next to sources often enough
+    // that deleting one is still noticed.
+    std::unordered_set<std::string_view> dirs;
+    dirs.insert(parent_dir(config.build_file));
+    for (uint32_t step : state.scope) {
+        for (uint32_t input : state.graph.steps()[step].input_nodes) {
+            if (!nodes[input].step_id.has_value())
+                dirs.insert(state.graph.dirs()[nodes[input].dir].path);
+        }
+    }
+    for (std::string_view dir : dirs) {
+        if (auto res = watcher.add(dir); !res)
+            return res;
+    }
+
+    std::vector<uint32_t> pending = compute_dirty(state);
+
+    for (;;) {
+        const bool ran = !pending.empty();
+        if (auto res = run_dirty(state, pending); !res) {
+            std::println(stderr, "Execution failed: {}", res.error());
+        }
+        if (state.depfiles_changed.load()) {
+            // A step picked up new inputs (e.g. a new #include): the graph has to be rebuilt.
+            return {};
+        }
+        // Steps that did not get to run (after a failure) stay dirty and are retried.
+        std::erase_if(pending, [&](uint32_t step) { return !state.dirty[step].dirty(); });
+        // A directory created since the last round (by a step, or next to a watched one) has
+        // sent no events for the files already in it, so everything is re-checked.
+        auto armed = watcher.rearm();
+        if (!armed)
+            return std::unexpected(armed.error());
+        if (*armed) {
+            pending = compute_dirty(state);
+            continue;
+        }
+        if (ran)
+            std::println("Watching for changes...");
+
+        DirWatcher::Changes changes = watcher.wait_for_changes();
+        if (changes.overflowed) {
+            pending = compute_dirty(state);
+            continue;
+        }
+
+        // Only the changed nodes, their producers and their consumers are looked at.
+        std::vector<uint32_t> candidates;
+        for (const auto &path : changes.paths) {
+            if (path == config.build_file)
+                return {};
+            auto node = state.graph.find_node(path);
+            if (!node)
+                continue;
+            state.stat_cache.refresh(static_cast<uint32_t>(*node));
+            if (nodes[*node].step_id.has_value())
+                candidates.push_back(static_cast<uint32_t>(*nodes[*node].step_id));
+            for (size_t out : nodes[*node].out_edges)
+                candidates.push_back(static_cast<uint32_t>(*nodes[out].step_id));
+        }
+        for (uint32_t step : candidates) {
+            if (!state.in_scope[step] || state.dirty[step].dirty())
+                continue;
+            state.dirty[step] = dirty_reason(state.graph, state.graph.steps()[step], state.stat_cache);
+            if (state.dirty[step].dirty())
+                pending.push_back(step);
+        }
+        propagate_dirty(state, pending);
+    }
+#endif
+}
+
+} // namespace catalyst
@@ -1,190 +1,401 @@
 #include "cbe/graph.hpp"
 
+#include "cbe/depfile.hpp"
+#include "cbe/deps_log.hpp"
 #include "cbe/domain.hpp"
+#include "cbe/hash.hpp"
 #include "cbe/mmap.hpp"
 #include "cbe/utility.hpp"
 
 #include <algorithm>
 #include <cstdint>
-#include <cstring>
 #include <filesystem>
 #include <format>
 #include <functional>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace fs = std::filesystem;
 
 namespace catalyst {
 
-size_t BuildGraph::get_or_create_node(std::string_view path) {
-    if (auto it = index_.find(path); it != index_.end()) {
+size_t BuildGraph::index_slot(std::string_view path) const {
+    Fnv1a hasher;
+    hasher.update(path);
+    const size_t mask = index_.size() - 1;
+    size_t slot = hasher.digest() & mask;
+    while (index_[slot] != INDEX_EMPTY && nodes_[index_[slot]].path != path)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+void BuildGraph::reserve_index_slot() {
+    static constexpr size_t TUNABLE__min_index_slots = 64;
+
+    // Kept at most half full so probe sequences stay short.
+    const size_t needed = 2 * (nodes_.size() + 1);
+    const bool owned = !index_.empty() && index_.data() == owned_index_.data();
+    if (owned && index_.size() >= needed)
+        return;
+
+    size_t slots = std::max(index_.size(), TUNABLE__min_index_slots);
+    while (slots < needed)
+        slots *= 2;
+    owned_index_.assign(slots, INDEX_EMPTY);
+    index_ = owned_index_;
+    for (size_t id = 0; id < nodes_.size(); ++id)
+        owned_index_[index_slot(nodes_[id].path)] = static_cast<uint32_t>(id);
+}
+
+uint32_t BuildGraph::get_or_create_dir(std::string_view dir) {
+    if (auto it = dir_index_.find(dir); it != dir_index_.end())
         return it->second;
+
+    // Ancestors first, so a directory's parent always has a smaller id.
+    const uint32_t parent = dir.empty() ? NO_DIR : get_or_create_dir(parent_dir(dir));
+    auto id = static_cast<uint32_t>(dirs_.size());
+    dirs_.push_back({dir, parent});
+    dir_index_.emplace(dir, id);
+    return id;
+}
+
+size_t BuildGraph::get_or_create_node(std::string_view path) {
+    if (!index_.empty()) {
+        if (uint32_t id = index_[index_slot(path)]; id != INDEX_EMPTY)
+            return id;
     }
 
+    reserve_index_slot();
     size_t id = nodes_.size();
-    nodes_.push_back({path, {}, std::nullopt});
-    index_.emplace(path, id);
+    // Directories are prefixes of the first path seen in them, so they cost no extra copy.
+    std::string_view owned = paths_.copy(path);
+    nodes_.push_back({owned, {}, std::nullopt, get_or_create_dir(parent_dir(owned))});
+    owned_index_[index_slot(owned)] = static_cast<uint32_t>(id);
     return id;
 }
 
+namespace {
+
+// Probing for .d files costs a stat per compile step; below this many per thread, one thread does it.
+constexpr size_t TUNABLE__min_compiles_per_thread = 256;
+
+bool reads_depfile(const BuildStep &step) {
+    return step.tool == "cc" || step.tool == "cxx";
+}
+
 /**
- * @brief Parses a Makefile-style dependency file (.d).
+ * @brief Parses a Makefile-style dependency file (.d), if there is one.
  *
- * This parser handles line continuations (\) and escaped spaces.
- * It invokes the callback for each dependency found.
+ * The file is unmapped again on return; every dependency is copied out by `callback`.
  *
- * @param graph The build graph (used to keep the memory mapped file alive).
  * @param path The path to the dependency file.
  * @param callback A callable that accepts a std::string_view for each dependency.
+ * @return False if the file does not exist or cannot be read.
  */
-void parseDepfile(BuildGraph &graph, const std::filesystem::path &path, auto callback) {
-    if (!fs::exists(path)) {
-        return;
+bool parseDepfile(const std::filesystem::path &path, auto callback) {
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        return false;
     }
-    auto map = std::make_shared<MappedFile>(path);
-    graph.add_resource(map);
-    std::string_view content = map->content();
-
-    if (content.empty())
-        return;
-
-    const char *ptr = content.data();
-    const char *end = ptr + content.size();
+    try {
+        MappedFile map(path);
+        parseDepfileContent(map.content(), callback);
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    return true;
+}
 
-    // 1. Skip to deps, ignoring final output
-    const char *colon = static_cast<const char *>(std::memchr(ptr, ':', end - ptr));
-    if (!colon)
-        return;
-    ptr = colon + 1;
-
-    // Main parsing loop
-    while (ptr < end) {
-        while (ptr < end) {
-            unsigned char c = *ptr;
-            if (c > ' ' && c != '\\')
-                break;
-
-            if (c <= ' ') {
-                ptr++;
-            } else if (c == '\\') {
-                if (ptr + 1 < end && (ptr[1] == '\n' || ptr[1] == '\r')) {
-                    ptr++; // skip
-                    if (*ptr == '\r')
-                        ptr++;
-                    if (ptr < end && *ptr == '\n')
-                        ptr++;
-                } else {
-                    break; // Escaped character, part of a filename
-                }
+} // namespace
+
+BuildGraph::StepBatch BuildGraph::resolve_steps(std::vector<BuildStep> steps, const DepsLog &deps_log,
+                                                size_t threads) {
+    StepBatch batch;
+
+    // Reading .d files is the only I/O here, so it is done first, spread over `threads`
+    // threads, into per-step lists. Everything that depends on order stays on this thread.
+    // A .d file is only left behind by a compile that was never recorded (an older version,
+    // or a run killed in between), so it is newer than the log.
+    std::vector<std::optional<std::vector<std::string_view>>> depfile_deps(steps.size());
+    const auto compiles = static_cast<size_t>(std::ranges::count_if(steps, reads_depfile));
+    threads = std::clamp<size_t>(compiles / TUNABLE__min_compiles_per_thread, 1, std::max<size_t>(threads, 1));
+    batch.strings.resize(threads);
+    auto load = [&](size_t t) {
+        for (size_t i = t; i < steps.size(); i += threads) {
+            if (!reads_depfile(steps[i]))
+                continue;
+            std::vector<std::string_view> deps;
+            if (parseDepfile(std::format("{}.d", steps[i].output),
+                             [&](std::string_view dep) { deps.push_back(batch.strings[t].copy(dep)); })) {
+                depfile_deps[i] = std::move(deps);
             }
         }
+    };
+    if (threads == 1) {
+        load(0);
+    } else {
+        std::vector<std::jthread> pool;
+        pool.reserve(threads);
+        for (size_t t = 0; t < threads; ++t)
+            pool.emplace_back(load, t);
+    }
 
-        if (ptr >= end)
-            break;
-
-        // Extract Token
-        const char *start = ptr;
-        while (ptr < end) {
-            unsigned char c = *ptr;
-
-            if (c <= ' ' || c == '\\')
-                break;
-            ptr++;
+    std::unordered_map<std::string_view, uint32_t> local_ids;
+    auto intern = [&](std::string_view path) {
+        auto [it, inserted] = local_ids.try_emplace(path, static_cast<uint32_t>(batch.paths.size()));
+        if (inserted)
+            batch.paths.push_back(path);
+        return it->second;
+    };
+    auto add_input = [&](std::string_view in_path) { batch.inputs.push_back(intern(in_path)); };
+
+    batch.outputs.reserve(steps.size());
+    batch.ranges.reserve(steps.size());
+    for (size_t i = 0; i < steps.size(); ++i) {
+        const BuildStep &step = steps[i];
+        // The output first, then the inputs: the order nodes are created in when merged.
+        batch.outputs.push_back(intern(step.output));
+
+        // Explicit inputs first, then opaque ones, so each kind is a contiguous range.
+        InputRange range{};
+        range.begin = static_cast<uint32_t>(batch.inputs.size());
+        // The list is only walked a second time if the first pass saw an opaque entry.
+        bool has_opaque = false;
+        for (bool opaque : {false, true}) {
+            std::string_view remaining = !opaque || has_opaque ? step.inputs : std::string_view{};
+            while (!remaining.empty()) {
+                size_t comma_pos = remaining.find(',');
+                std::string_view in_path = remaining.substr(0, comma_pos);
+                remaining =
+                    comma_pos == std::string_view::npos ? std::string_view{} : remaining.substr(comma_pos + 1);
+
+                has_opaque = has_opaque || in_path.starts_with('!');
+                if (!in_path.empty() && in_path.starts_with('!') == opaque)
+                    add_input(opaque ? in_path.substr(1) : in_path);
+            }
+            (opaque ? range.opaque_end : range.explicit_end) = static_cast<uint32_t>(batch.inputs.size());
         }
 
-        // Handle the edge case of an escaped space or line continuation within a token
-        if (ptr < end && *ptr == '\\') {
-            // If we hit a backslash, we fall back to a slower scan for this specific token
-            while (ptr < end) {
-                if (*ptr == '\\') {
-                    if (ptr + 1 >= end) {
-                        // Dangling backslash at EOF
-                        ++ptr;
-                        break;
-                    }
-                    if (ptr[1] == '\n' || ptr[1] == '\r') {
-                        break; // line continuation
-                    }
-                    ptr += 2; // Safe: we know ptr + 1 < end
-                } else if (static_cast<unsigned char>(*ptr) <= ' ') {
-                    break;
-                } else {
-                    ptr++;
-                }
+        if (reads_depfile(step)) {
+            if (depfile_deps[i]) {
+                std::ranges::for_each(*depfile_deps[i], add_input);
+            } else if (auto deps = deps_log.deps(step.output)) {
+                for (uint32_t dep : *deps)
+                    add_input(deps_log.path(dep));
             }
+        } else if (step.tool == "ld" || step.tool == "sld" || step.tool == "ar") {
+            // TODO: parse .rsp file
         }
+        range.end = static_cast<uint32_t>(batch.inputs.size());
+        batch.ranges.push_back(range);
+    }
+    batch.steps = std::move(steps);
+    return batch;
+}
 
-        if (ptr > start) {
-            callback(std::string_view(start, ptr - start));
+Result<void> BuildGraph::add_resolved(StepBatch &&batch) {
+    // Paths in order of first appearance, so merging batches in order numbers nodes
+    // exactly as adding their steps one by one would.
+    std::vector<uint32_t> ids(batch.paths.size());
+    for (size_t i = 0; i < batch.paths.size(); ++i)
+        ids[i] = static_cast<uint32_t>(get_or_create_node(batch.paths[i]));
+
+    for (size_t i = 0; i < batch.steps.size(); ++i) {
+        BuildStep &step = batch.steps[i];
+        const uint32_t out_id = ids[batch.outputs[i]];
+        if (nodes_[out_id].step_id.has_value()) { // 2 different steps create the same file.
+            return std::unexpected(std::format("Duplicate producer for output: {}", step.output));
         }
+        step.output_node = out_id;
+        step.output = nodes_[out_id].path;
+
+        const InputRange &local = batch.ranges[i];
+        const auto begin = static_cast<uint32_t>(step_inputs_.size());
+        for (uint32_t k = local.begin; k < local.end; ++k) {
+            const uint32_t in_id = ids[batch.inputs[k]];
+            step_inputs_.push_back(in_id);
+            edge_list_.emplace_back(in_id, out_id);
+        }
+
+        nodes_[out_id].step_id = steps_.size();
+        steps_.push_back(step);
+        input_ranges_.push_back({.begin = begin,
+                                 .explicit_end = begin + (local.explicit_end - local.begin),
+                                 .opaque_end = begin + (local.opaque_end - local.begin),
+                                 .end = begin + (local.end - local.begin)});
+        finalized_ = false;
     }
+    return {};
 }
 
 Result<size_t> BuildGraph::add_step(BuildStep step) {
-    size_t out_id = get_or_create_node(step.output);
+    std::vector<BuildStep> steps;
+    steps.push_back(std::move(step));
+    if (auto res = add_resolved(resolve_steps(std::move(steps), deps_log(), 1)); !res)
+        return std::unexpected(res.error());
+    return steps_.size() - 1;
+}
+
+void BuildGraph::finalize() {
+    if (finalized_)
+        return;
 
-    if (nodes_[out_id].step_id.has_value()) { // 2 different steps create the same file.
-        return std::unexpected(std::format("Duplicate producer for output: {}", step.output));
+    // Counting sort of the edge list by source node; stable, so edges keep insertion order.
+    std::vector<uint32_t> offsets(nodes_.size() + 1, 0);
+    for (auto [from, to] : edge_list_)
+        offsets[from + 1]++;
+    for (size_t i = 0; i < nodes_.size(); ++i)
+        offsets[i + 1] += offsets[i];
+
+    edges_.resize(edge_list_.size());
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (auto [from, to] : edge_list_)
+        edges_[cursor[from]++] = to;
+
+    for (size_t i = 0; i < nodes_.size(); ++i)
+        nodes_[i].out_edges = std::span<const uint32_t>(edges_).subspan(offsets[i], offsets[i + 1] - offsets[i]);
+
+    const std::span<const uint32_t> inputs(step_inputs_);
+    for (size_t i = 0; i < steps_.size(); ++i) {
+        const InputRange &r = input_ranges_[i];
+        BuildStep &step = steps_[i];
+        step.input_nodes = inputs.subspan(r.begin, r.end - r.begin);
+        step.parsed_inputs = inputs.subspan(r.begin, r.explicit_end - r.begin);
+        step.opaque_inputs = inputs.subspan(r.explicit_end, r.opaque_end - r.explicit_end);
+        step.depfile_inputs = inputs.subspan(r.opaque_end, r.end - r.opaque_end);
     }
+    finalized_ = true;
+}
 
-    // Populate parsed_inputs
-    std::string_view remaining = step.inputs;
-    // PERF: posibily faster to do with memchr
-    while (!remaining.empty()) {
-        size_t comma_pos = remaining.find(',');
-        std::string_view in_path;
-        if (comma_pos == std::string_view::npos) {
-            in_path = remaining;
-            remaining = {};
-        } else {
-            in_path = remaining.substr(0, comma_pos);
-            remaining = remaining.substr(comma_pos + 1);
-        }
+std::optional<size_t> BuildGraph::find_node(std::string_view path) const {
+    if (index_.empty())
+        return std::nullopt;
+    if (uint32_t id = index_[index_slot(path)]; id != INDEX_EMPTY)
+        return id;
+    return std::nullopt;
+}
+
+bool BuildGraph::depfile_changed(size_t step_id, std::span<const std::string_view> deps) const {
+    const BuildStep &step = steps_[step_id];
+    if (deps.size() != step.depfile_inputs.size())
+        return true;
+    return std::ranges::any_of(deps, [&](std::string_view dep) {
+        auto in_id = find_node(dep);
+        const auto &edges = in_id ? nodes_[*in_id].out_edges : std::span<const uint32_t>{};
+        return std::ranges::find(edges, step.output_node) == edges.end();
+    });
+}
+
+DepsLog &BuildGraph::deps_log() {
+    if (!deps_log_)
+        deps_log_ = std::make_shared<DepsLog>(deps_file_);
+    return *deps_log_;
+}
+
+BuildGraph::StepDag BuildGraph::step_dag() const {
+    StepDag dag;
+    dag.offsets.assign(steps_.size() + 1, 0);
 
-        if (!in_path.empty()) {
-            if (in_path.starts_with('!')) {
-                auto opaque_path = in_path.substr(1);
-                if (!step.opaque_inputs)
-                    step.opaque_inputs.emplace();
-                step.opaque_inputs->push_back(opaque_path);
-            } else {
-                step.parsed_inputs.push_back(in_path);
+    // Every edge points at an output, so a node's out-edges become dependents of the step
+    // producing it. Edges out of source nodes are dropped.
+    for (const auto &node : nodes_) {
+        if (node.step_id.has_value())
+            dag.offsets[*node.step_id + 1] = static_cast<uint32_t>(node.out_edges.size());
+    }
+    for (size_t i = 0; i < steps_.size(); ++i)
+        dag.offsets[i + 1] += dag.offsets[i];
+
+    dag.successors.resize(dag.offsets.back());
+    for (const auto &node : nodes_) {
+        if (!node.step_id.has_value())
+            continue;
+        uint32_t cursor = dag.offsets[*node.step_id];
+        for (size_t out : node.out_edges)
+            dag.successors[cursor++] = static_cast<uint32_t>(*nodes_[out].step_id);
+    }
+    return dag;
+}
+
+Result<void> BuildGraph::check_acyclic(const StepDag &dag) const {
+    enum class STATUS : uint8_t { UNSTARTED, WORKING, FINISHED };
+
+    std::vector<STATUS> status(steps_.size(), STATUS::UNSTARTED);
+    // A step and the offset of its next successor to visit; iterative, so long chains cannot
+    // overflow the stack.
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    for (uint32_t root = 0; root < steps_.size(); ++root) {
+        if (status[root] != STATUS::UNSTARTED)
+            continue;
+        status[root] = STATUS::WORKING;
+        stack.emplace_back(root, dag.offsets[root]);
+        while (!stack.empty()) {
+            auto &[step, next] = stack.back();
+            if (next == dag.offsets[step + 1]) {
+                status[step] = STATUS::FINISHED;
+                stack.pop_back();
+                continue;
+            }
+            const uint32_t succ = dag.successors[next++];
+            if (status[succ] == STATUS::WORKING)
+                return std::unexpected(std::format("Cycle detected in the build graph at: {}", steps_[succ].output));
+            if (status[succ] == STATUS::UNSTARTED) {
+                status[succ] = STATUS::WORKING;
+                stack.emplace_back(succ, dag.offsets[succ]);
             }
         }
     }
+    return {};
+}
 
-    size_t step_id = steps_.size();
-    steps_.push_back(step); // Store the step
-    nodes_[out_id].step_id = step_id;
-
-    if (step.tool == "cc" || step.tool == "cxx") {
-        auto depfile_parse_callback = [this, out_id, &step = steps_.back()](std::string_view fn) {
-            size_t in_id = get_or_create_node(fn);
-            this->nodes_[in_id].out_edges.push_back(out_id);
-            if (!step.depfile_inputs)
-                step.depfile_inputs.emplace();
-            step.depfile_inputs->emplace_back(fn);
-        };
-        const fs::path depfile_path = std::format("{}.d", step.output);
-        parseDepfile(*this, depfile_path, depfile_parse_callback);
-    } else if (step.tool == "ld" || step.tool == "sld" || step.tool == "ar") {
-        // TODO: parse .rsp file
-    }
+Result<std::vector<uint32_t>> BuildGraph::steps_for_targets(std::span<const std::string> targets) const {
+    std::vector<uint8_t> needed(steps_.size(), 0);
+    std::vector<uint32_t> stack;
+    auto want = [&](size_t step) {
+        if (!needed[step]) {
+            needed[step] = 1;
+            stack.push_back(static_cast<uint32_t>(step));
+        }
+    };
 
-    // Iterate over parsed_inputs to add edges
-    for (const auto &in_path : step.parsed_inputs) {
-        size_t in_id = get_or_create_node(in_path);
-        nodes_[in_id].out_edges.push_back(out_id);
+    for (const std::string &target : targets) {
+        if (auto node = find_node(target)) {
+            if (!nodes_[*node].step_id)
+                return std::unexpected(std::format("Target {} is not produced by any step", target));
+            want(*nodes_[*node].step_id);
+            continue;
+        }
+        if (!target.ends_with('/'))
+            return std::unexpected(std::format("Unknown target: {}", target));
+        bool matched = false;
+        for (const auto &step : steps_) {
+            if (step.output.starts_with(target)) {
+                want(*nodes_[step.output_node].step_id);
+                matched = true;
+            }
+        }
+        if (!matched)
+            return std::unexpected(std::format("No outputs under {}", target));
     }
 
-    // Iterate over opaque_inputs to add edges
-    if (step.opaque_inputs) {
-        for (const auto &in_path : *step.opaque_inputs) {
-            size_t in_id = get_or_create_node(in_path);
-            nodes_[in_id].out_edges.push_back(out_id);
+    // Walk producers of inputs; depfile inputs count too, since a header may be generated.
+    while (!stack.empty()) {
+        const uint32_t step = stack.back();
+        stack.pop_back();
+        for (uint32_t input : steps_[step].input_nodes) {
+            if (nodes_[input].step_id)
+                want(*nodes_[input].step_id);
         }
     }
 
-    return step_id;
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < steps_.size(); ++i) {
+        if (needed[i])
+            ids.push_back(static_cast<uint32_t>(i));
+    }
+    return ids;
 }
 
 Result<std::vector<size_t>> BuildGraph::topo_sort() const {
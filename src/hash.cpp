@@ -0,0 +1,24 @@
+#include "cbe/hash.hpp"
+
+#include "cbe/mmap.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+
+namespace catalyst {
+
+bool ContentHasher::update_file(const std::filesystem::path &path) {
+    try {
+        MappedFile file(path);
+        const uint64_t size = file.content().size();
+        update(std::string_view(reinterpret_cast<const char *>(&size), sizeof(size)));
+        update(file.content());
+        return true;
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+}
+
+} // namespace catalyst
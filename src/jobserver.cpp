@@ -0,0 +1,220 @@
+#include "cbe/jobserver.hpp"
+
+#include "cbe/process_exec.hpp"
+#include "cbe/utility.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace catalyst {
+
+#ifndef _WIN32
+namespace {
+
+/** @brief The value of the last `--jobserver-auth=` (or pre-4.2 `--jobserver-fds=`) in `MAKEFLAGS`. */
+std::optional<std::string_view> jobserver_auth(std::string_view makeflags) {
+    std::optional<std::string_view> auth;
+    size_t auth_pos = 0;
+    for (std::string_view flag : {std::string_view("--jobserver-auth="), std::string_view("--jobserver-fds=")}) {
+        size_t pos = makeflags.rfind(flag);
+        if (pos == std::string_view::npos || (auth && pos < auth_pos))
+            continue;
+        std::string_view value = makeflags.substr(pos + flag.size());
+        auth = value.substr(0, value.find(' '));
+        auth_pos = pos;
+    }
+    return auth;
+}
+
+bool fd_open(int fd) {
+    return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+}
+
+} // namespace
+
+std::unique_ptr<Jobserver> Jobserver::from_environment() {
+    const char *makeflags = std::getenv("MAKEFLAGS");
+    if (makeflags == nullptr)
+        return nullptr;
+    auto auth = jobserver_auth(makeflags);
+    if (!auth)
+        return nullptr;
+
+    std::unique_ptr<Jobserver> client(new Jobserver());
+    if (auth->starts_with("fifo:")) {
+        // Our own open file description, so non-blocking mode does not leak into make.
+        const std::string path(auth->substr(5));
+        client->read_fd_ = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (client->read_fd_ < 0)
+            return nullptr;
+        client->write_fd_ = client->read_fd_;
+        client->owns_read_fd_ = client->owns_write_fd_ = true;
+        return client;
+    }
+
+    // "R,W": descriptors inherited from make. They are closed if make did not mean to
+    // share them with us (e.g. the rule was not marked recursive).
+    int fds[2] = {-1, -1};
+    size_t comma = auth->find(',');
+    if (comma == std::string_view::npos)
+        return nullptr;
+    std::from_chars(auth->data(), auth->data() + comma, fds[0]);
+    std::from_chars(auth->data() + comma + 1, auth->data() + auth->size(), fds[1]);
+    if (!fd_open(fds[0]) || !fd_open(fds[1]))
+        return nullptr;
+    client->write_fd_ = fds[1];
+    client->read_fd_ = fds[0];
+#ifdef __linux__
+    // Reopening the pipe gives a description of our own that can be non-blocking.
+    if (int fd = open(std::format("/proc/self/fd/{}", fds[0]).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC); fd >= 0) {
+        client->read_fd_ = fd;
+        client->owns_read_fd_ = true;
+    }
+    // Children find the pipe under the same numbers.
+    process_inherit_fds_through(std::max(fds[0], fds[1]));
+#endif
+    return client;
+}
+
+Result<std::unique_ptr<Jobserver>> Jobserver::create(size_t jobs) {
+    static std::atomic<size_t> counter = 0;
+    std::error_code ec;
+    std::filesystem::path path = std::filesystem::temp_directory_path(ec);
+    if (ec)
+        return std::unexpected(std::format("Failed to find a directory for the jobserver: {}", ec.message()));
+    path /= std::format("cbe-jobserver-{}-{}", getpid(), counter.fetch_add(1));
+
+    if (mkfifo(path.c_str(), 0600) != 0)
+        return std::unexpected(std::format("Failed to create {}: {}", path.string(), std::strerror(errno)));
+    std::unique_ptr<Jobserver> server(new Jobserver());
+    server->fifo_path_ = path;
+    server->read_fd_ = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (server->read_fd_ < 0)
+        return std::unexpected(std::format("Failed to open {}: {}", path.string(), std::strerror(errno)));
+    server->write_fd_ = server->read_fd_;
+    server->owns_read_fd_ = server->owns_write_fd_ = true;
+
+    // Our own implicit slot is not in the fifo.
+    const std::string tokens(std::max<size_t>(jobs, 1) - 1, '+');
+    if (!tokens.empty() &&
+        write(server->write_fd_, tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size()))
+        return std::unexpected(std::format("Failed to fill {}: {}", path.string(), std::strerror(errno)));
+
+    std::string makeflags;
+    server->advertised_ = true;
+    if (const char *previous = std::getenv("MAKEFLAGS"); previous != nullptr) {
+        server->makeflags_ = previous;
+        if (*previous != '\0')
+            makeflags = std::format("{} ", previous);
+    }
+    makeflags += std::format("-j{} --jobserver-auth=fifo:{}", std::max<size_t>(jobs, 1), path.string());
+    setenv("MAKEFLAGS", makeflags.c_str(), 1);
+    return server;
+}
+
+Jobserver::~Jobserver() {
+    {
+        std::lock_guard lock(tokens_mtx_);
+        if (!tokens_.empty()) {
+            [[maybe_unused]] auto written = write(write_fd_, tokens_.data(), tokens_.size());
+        }
+    }
+    if (owns_read_fd_)
+        close(read_fd_);
+    if (owns_write_fd_ && write_fd_ != read_fd_)
+        close(write_fd_);
+    if (!fifo_path_.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(fifo_path_, ec);
+    }
+    if (advertised_) {
+        if (makeflags_)
+            setenv("MAKEFLAGS", makeflags_->c_str(), 1);
+        else
+            unsetenv("MAKEFLAGS");
+    }
+#ifdef __linux__
+    process_inherit_fds_through(STDERR_FILENO);
+#endif
+}
+
+bool Jobserver::try_acquire() {
+    // Polled first: an inherited pipe may be blocking, and another client may drain it.
+    pollfd pfd{.fd = read_fd_, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, 0) <= 0 || (pfd.revents & POLLIN) == 0)
+        return false;
+    char token = 0;
+    if (read(read_fd_, &token, 1) != 1)
+        return false;
+    std::lock_guard lock(tokens_mtx_);
+    tokens_.push_back(token);
+    return true;
+}
+
+Result<void> Jobserver::acquire() {
+    while (!try_acquire()) {
+        pollfd pfd{.fd = read_fd_, .events = POLLIN, .revents = 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            return std::unexpected(std::format("Failed to wait for a jobserver token: {}", std::strerror(errno)));
+        if ((pfd.revents & (POLLERR | POLLHUP)) != 0 && (pfd.revents & POLLIN) == 0)
+            return std::unexpected("The jobserver went away");
+    }
+    return {};
+}
+
+void Jobserver::release() {
+    char token = '+';
+    {
+        std::lock_guard lock(tokens_mtx_);
+        if (tokens_.empty())
+            return;
+        token = tokens_.back();
+        tokens_.pop_back();
+    }
+    while (write(write_fd_, &token, 1) < 0 && errno == EINTR) {
+    }
+}
+#else
+std::unique_ptr<Jobserver> Jobserver::from_environment() {
+    return nullptr;
+}
+
+Result<std::unique_ptr<Jobserver>> Jobserver::create(size_t) {
+    return std::unexpected("Jobservers are not supported on this platform");
+}
+
+Jobserver::~Jobserver() = default;
+
+bool Jobserver::try_acquire() {
+    return false;
+}
+
+Result<void> Jobserver::acquire() {
+    return std::unexpected("Jobservers are not supported on this platform");
+}
+
+void Jobserver::release() {
+}
+#endif
+
+} // namespace catalyst
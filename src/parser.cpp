@@ -2,76 +2,126 @@
 
 #include "cbe/binary.hpp"
 #include "cbe/builder.hpp"
+#include "cbe/deps_log.hpp"
+#include "cbe/graph.hpp"
 #include "cbe/mmap.hpp"
+#include "cbe/scan.hpp"
 #include "cbe/utility.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <ranges>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace catalyst {
 
 namespace {
 
-Result<void> parse_def(const std::string_view line, CBEBuilder &builder) {
-    size_t first_pipe = line.find('|');
+// Small manifests are not worth a thread; big ones get at least this much text per chunk.
+constexpr size_t TUNABLE__min_chunk_bytes = size_t{1} << 20;
+
+/** @brief Everything parsed from one newline-aligned chunk of the manifest. */
+struct Chunk {
+    std::string_view text;
+    std::vector<std::pair<std::string_view, std::string_view>> definitions;
+    std::vector<std::pair<std::string_view, size_t>> pools;
+    std::vector<BuildStep> steps;
+    std::optional<std::string> error; ///< The first malformed line; nothing after it was parsed.
+    BuildGraph::StepBatch batch;
+};
+
+// Pipe offsets are relative to `line`; `npos` means the line has fewer pipes.
+
+Result<std::pair<std::string_view, std::string_view>> parse_def(const std::string_view line, size_t first_pipe,
+                                                                size_t second_pipe) {
     if (first_pipe == std::string_view::npos) {
         return std::unexpected(std::format("Malformed def line (missing first pipe): {}", line));
     }
 
-    size_t second_pipe = line.find('|', first_pipe + 1);
     if (second_pipe == std::string_view::npos) {
         return std::unexpected(std::format("Malformed def line (missing second pipe): {}", line));
     }
 
-    builder.add_definition(line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)), // key
-                           line.substr(second_pipe + 1)                                 // value
-    );
+    return std::pair{line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)), // key
+                     line.substr(second_pipe + 1)};                                // value
+}
 
-    return {};
+Result<std::pair<std::string_view, size_t>> parse_pool(const std::string_view line, size_t first_pipe,
+                                                       size_t second_pipe) {
+    if (first_pipe == std::string_view::npos || second_pipe == std::string_view::npos) {
+        return std::unexpected(std::format("Malformed pool line (expected POOL|<name>|<depth>): {}", line));
+    }
+
+    std::string_view name = line.substr(first_pipe + 1, second_pipe - (first_pipe + 1));
+    std::string_view depth_str = line.substr(second_pipe + 1);
+    size_t depth = 0;
+    auto [ptr, ec] = std::from_chars(depth_str.data(), depth_str.data() + depth_str.size(), depth);
+    if (name.empty() || ec != std::errc{} || ptr != depth_str.data() + depth_str.size() || depth == 0) {
+        return std::unexpected(std::format("Malformed pool line (expected a name and a positive depth): {}", line));
+    }
+    return std::pair{name, depth};
 }
 
-Result<void> parse_step(const std::string_view line, CBEBuilder &builder) {
-    size_t first_pipe = line.find('|');
+Result<BuildStep> parse_step(const std::string_view line, size_t first_pipe, size_t second_pipe) {
     if (first_pipe == std::string_view::npos) {
         return std::unexpected(std::format("Malformed step line (missing first pipe): {}", line));
     }
 
-    size_t second_pipe = line.find('|', first_pipe + 1);
     if (second_pipe == std::string_view::npos) {
         return std::unexpected(std::format("Malformed step line (missing second pipe): {}", line));
     }
-    Result<void> res = builder.add_step({.tool = line.substr(0, first_pipe),
-                                         .inputs = line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)),
-                                         .output = line.substr(second_pipe + 1),
-                                         .depfile_inputs = std::nullopt,
-                                         .parsed_inputs = {}});
-    if (!res) {
-        return std::unexpected(res.error());
+    // An optional fourth column names the step's pool, an optional fifth lists its options.
+    std::string_view output = line.substr(second_pipe + 1);
+    std::string_view pool;
+    std::string_view options;
+    if (size_t third_pipe = output.find('|'); third_pipe != std::string_view::npos) {
+        pool = output.substr(third_pipe + 1);
+        output = output.substr(0, third_pipe);
     }
-    return {};
-}
-
-} // namespace
-
-Result<void> parse(CBEBuilder &builder, const std::filesystem::path &path) {
-#if FF_cbe__binary == 1
-    if (std::filesystem::exists(".catalyst.bin") &&
-        std::filesystem::last_write_time(".catalyst.bin") > std::filesystem::last_write_time(path)) {
-        return parse_bin(builder);
+    if (size_t fourth_pipe = pool.find('|'); fourth_pipe != std::string_view::npos) {
+        options = pool.substr(fourth_pipe + 1);
+        pool = pool.substr(0, fourth_pipe);
     }
-#endif
-    std::string_view content;
-    try {
-        auto file = std::make_shared<MappedFile>(path);
-        builder.add_resource(file);
-        content = file->content();
-    } catch (const std::exception &err) {
-        return std::unexpected(err.what());
+    bool restat = false;
+    for (auto part : std::views::split(options, ',')) {
+        std::string_view option(part.begin(), part.end());
+        if (option == "restat")
+            restat = true;
+        else if (!option.empty())
+            return std::unexpected(std::format("Unknown step option {}: {}", option, line));
     }
+    return BuildStep{.tool = line.substr(0, first_pipe),
+                     .inputs = line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)),
+                     .output = output,
+                     .pool = pool,
+                     .restat = restat};
+}
 
+void parse_chunk(Chunk &chunk) {
+    std::string_view content = chunk.text;
     size_t start = 0;
     while (start < content.size()) {
-        size_t end = content.find('\n', start);
+        // One scan finds the first two pipes and, usually, the end of the line; anything
+        // after the second pipe is the value/output, so the rest of the line only needs memchr.
+        size_t pipes[2] = {std::string_view::npos, std::string_view::npos};
+        size_t pos = find_pipe_or_newline(content, start);
+        for (size_t &pipe : pipes) {
+            if (pos == content.size() || content[pos] == '\n')
+                break;
+            pipe = pos - start;
+            pos = find_pipe_or_newline(content, pos + 1);
+        }
+        size_t end = pos;
+        if (pos < content.size() && content[pos] != '\n') {
+            end = content.find('\n', pos);
+        }
         // last line of the file
         if (end == std::string_view::npos) {
             end = content.size();
@@ -87,18 +137,110 @@ Result<void> parse(CBEBuilder &builder, const std::filesystem::path &path) {
             if (line.starts_with("#")) {
                 // Comment
             } else if (line.starts_with("DEF|")) {
-                auto res = parse_def(line, builder);
-                if (!res)
-                    return res;
+                auto res = parse_def(line, pipes[0], pipes[1]);
+                if (!res) {
+                    chunk.error = res.error();
+                    return;
+                }
+                chunk.definitions.push_back(*res);
+            } else if (line.starts_with("POOL|")) {
+                auto res = parse_pool(line, pipes[0], pipes[1]);
+                if (!res) {
+                    chunk.error = res.error();
+                    return;
+                }
+                chunk.pools.push_back(*res);
             } else {
-                auto res = parse_step(line, builder);
-                if (!res)
-                    return res;
+                auto res = parse_step(line, pipes[0], pipes[1]);
+                if (!res) {
+                    chunk.error = res.error();
+                    return;
+                }
+                chunk.steps.push_back(*res);
             }
         }
 
         start = end + 1;
     }
+}
+
+/** @brief Splits `content` into about `count` pieces, each ending just after a newline (or at the end). */
+std::vector<Chunk> split_chunks(std::string_view content, size_t count) {
+    std::vector<Chunk> chunks;
+    chunks.reserve(count);
+    size_t start = 0;
+    for (size_t i = 1; i <= count && start < content.size(); ++i) {
+        size_t end = content.size();
+        if (i < count) {
+            end = content.find('\n', std::max(start, (content.size() / count) * i));
+            end = end == std::string_view::npos ? content.size() : end + 1;
+        }
+        chunks.emplace_back().text = content.substr(start, end - start);
+        start = end;
+    }
+    return chunks;
+}
+
+} // namespace
+
+Result<void> parse(CBEBuilder &builder, const std::filesystem::path &path) {
+#if FF_cbe__binary == 1
+    if (std::filesystem::exists(".catalyst.bin") &&
+        std::filesystem::last_write_time(".catalyst.bin") > std::filesystem::last_write_time(path)) {
+        if (parse_bin(builder))
+            return {};
+        // A corrupt or outdated cache is not fatal: fall back to the manifest, which rewrites it.
+        const std::filesystem::path deps_file = builder.graph_.deps_file();
+        builder = CBEBuilder{};
+        builder.set_deps_file(deps_file);
+    }
+#endif
+    std::string_view content;
+    try {
+        auto file = std::make_shared<MappedFile>(path);
+        builder.add_resource(file);
+        content = file->content();
+    } catch (const std::exception &err) {
+        return std::unexpected(err.what());
+    }
+
+    // Lines are parsed and their steps resolved on one thread per chunk. The chunks are
+    // then merged in file order, so node ids, the first definition of a key winning, and
+    // which error is reported all match a line-by-line parse.
+    const size_t threads = std::clamp<size_t>(
+        content.size() / TUNABLE__min_chunk_bytes, 1, std::max<size_t>(1, std::thread::hardware_concurrency()));
+    std::vector<Chunk> chunks = split_chunks(content, threads);
+    const DepsLog &deps_log = builder.graph_.deps_log();
+    // Each chunk reads its .d files on its share of the hardware threads.
+    const size_t depfile_threads = std::max<size_t>(1, std::thread::hardware_concurrency() / chunks.size());
+    auto process = [&deps_log, depfile_threads](Chunk &chunk) {
+        parse_chunk(chunk);
+        chunk.batch = BuildGraph::resolve_steps(std::move(chunk.steps), deps_log, depfile_threads);
+    };
+    if (chunks.size() == 1) {
+        process(chunks.front());
+    } else {
+        std::vector<std::jthread> pool;
+        pool.reserve(chunks.size());
+        for (auto &chunk : chunks)
+            pool.emplace_back(process, std::ref(chunk));
+    }
+
+    for (auto &chunk : chunks) {
+        for (const auto &[key, value] : chunk.definitions)
+            builder.add_definition(key, value);
+        for (const auto &[name, depth] : chunk.pools)
+            builder.add_pool(name, depth);
+        if (auto res = builder.graph_.add_resolved(std::move(chunk.batch)); !res)
+            return res;
+        if (chunk.error)
+            return std::unexpected(std::move(*chunk.error));
+    }
+    // Pools may be declared anywhere in the file, so steps are only checked once all are known.
+    for (const auto &step : builder.graph_.steps()) {
+        if (!step.pool.empty() && !builder.pools().contains(step.pool))
+            return std::unexpected(std::format("Step {} uses undeclared pool {}", step.output, step.pool));
+    }
 #if FF_cbe__binary
     auto _ = emit_bin(builder);
 #endif
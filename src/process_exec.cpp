@@ -3,15 +3,205 @@
 #include "cbe/utility.hpp"
 
 #include <expected>
-#include <future>
+#include <format>
 #include <optional>
-#include <reproc++/run.hpp>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#ifdef __linux__
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <spawn.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ; // NOLINT(readability-redundant-declaration)
+
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 34)
+#define CBE_SPAWN_CLOSEFROM 1
+#endif
+#endif
+#else
+#include <reproc++/run.hpp>
+#endif
+
 namespace catalyst {
+
+#ifdef __linux__
+namespace {
+
+std::atomic<int> last_inherited_fd = STDERR_FILENO;
+
+Result<pid_t> spawn(std::vector<std::string> &&args,
+                    const std::optional<std::string> &working_dir,
+                    const std::optional<std::unordered_map<std::string, std::string>> &env,
+                    int output_fd = -1) {
+    if (args.empty()) {
+        return std::unexpected("Cannot execute empty command");
+    }
+
+    std::vector<char *> argv;
+    argv.reserve(args.size() + 1);
+    for (auto &arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    // Without overrides the child gets our environment block as is; nothing is copied.
+    char **envp = environ;
+    std::vector<std::string> env_strings;
+    std::vector<char *> env_ptrs;
+    if (env) {
+        for (char **var = environ; *var != nullptr; ++var) {
+            std::string_view entry(*var);
+            if (!env->contains(std::string(entry.substr(0, entry.find('=')))))
+                env_ptrs.push_back(*var);
+        }
+        for (const auto &[key, value] : *env)
+            env_strings.push_back(key + "=" + value);
+        for (auto &s : env_strings)
+            env_ptrs.push_back(s.data());
+        env_ptrs.push_back(nullptr);
+        envp = env_ptrs.data();
+    }
+
+    // glibc implements posix_spawn with clone(CLONE_VM | CLONE_VFORK), so the cost does not
+    // grow with our address space the way fork() does. Output is inherited unless captured.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (output_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, output_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, output_fd, STDERR_FILENO);
+    }
+    if (working_dir)
+        posix_spawn_file_actions_addchdir_np(&actions, working_dir->c_str());
+#ifdef CBE_SPAWN_CLOSEFROM
+    // Logs and mapped files are opened without O_CLOEXEC; compilers should not inherit them.
+    posix_spawn_file_actions_addclosefrom_np(&actions, last_inherited_fd.load(std::memory_order_relaxed) + 1);
+#endif
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid = 0;
+    const int err = posix_spawnp(&pid, argv.front(), &actions, &attr, argv.data(), envp);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        return std::unexpected(std::format("Failed to spawn {}: {}", args.front(), std::strerror(err)));
+    }
+    return pid;
+}
+
+Result<int> wait_pid(pid_t pid, rusage *usage = nullptr) {
+    int status = 0;
+    while (wait4(pid, &status, 0, usage) < 0) {
+        if (errno != EINTR)
+            return std::unexpected(std::format("Failed to wait for process {}: {}", pid, std::strerror(errno)));
+    }
+    // Like a shell: a child killed by a signal reports 128 + the signal number.
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/** @brief Reads all of `fd` from the start. */
+std::string read_all(int fd) {
+    std::string out;
+    char buf[16 * 1024];
+    for (off_t offset = 0;;) {
+        const ssize_t len = pread(fd, buf, sizeof(buf), offset);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return out;
+        out.append(buf, static_cast<size_t>(len));
+        offset += len;
+    }
+}
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+} // namespace
+
+Result<int> process_exec(std::vector<std::string> &&args,
+                         std::optional<std::string> working_dir,
+                         std::optional<std::unordered_map<std::string, std::string>> env) {
+    auto pid = spawn(std::move(args), working_dir, env);
+    if (!pid)
+        return std::unexpected(pid.error());
+    return wait_pid(*pid);
+}
+
+void process_inherit_fds_through(int fd) {
+    last_inherited_fd.store(std::max(fd, STDERR_FILENO), std::memory_order_relaxed);
+}
+
+bool pidfd_supported() {
+    static const bool supported = [] {
+        const int fd = open_pidfd(getpid());
+        if (fd < 0)
+            return false;
+        close(fd);
+        return true;
+    }();
+    return supported;
+}
+
+Result<ChildProcess> process_spawn(std::vector<std::string> &&args,
+                                   std::optional<std::string> working_dir,
+                                   std::optional<std::unordered_map<std::string, std::string>> env,
+                                   bool capture_output) {
+    int output_fd = -1;
+    if (capture_output) {
+        output_fd = memfd_create("cbe-output", MFD_CLOEXEC);
+        if (output_fd < 0)
+            return std::unexpected(std::format("Failed to capture the output: {}", std::strerror(errno)));
+    }
+    auto pid = spawn(std::move(args), working_dir, env, output_fd);
+    if (!pid) {
+        if (output_fd >= 0)
+            close(output_fd);
+        return std::unexpected(pid.error());
+    }
+    // The child cannot be reaped before we wait for it, so the pid is still ours here.
+    return ChildProcess{.pid = *pid, .pidfd = open_pidfd(*pid), .output_fd = output_fd};
+}
+
+Result<int> process_wait(ChildProcess &child) {
+    rusage usage{};
+    auto res = wait_pid(child.pid, &usage);
+    // In kilobytes on Linux; covers the descendants the child waited for, e.g. cc1 under the driver.
+    child.peak_rss_kib = static_cast<size_t>(usage.ru_maxrss);
+    if (child.pidfd >= 0) {
+        close(child.pidfd);
+        child.pidfd = -1;
+    }
+    if (child.output_fd >= 0) {
+        child.output = read_all(child.output_fd);
+        close(child.output_fd);
+        child.output_fd = -1;
+    }
+    return res;
+}
+#else
 Result<int> process_exec(std::vector<std::string> &&args,
                          std::optional<std::string> working_dir,
                          std::optional<std::unordered_map<std::string, std::string>> env) {
@@ -44,7 +234,8 @@ Result<int> process_exec(std::vector<std::string> &&args,
     auto [status, ec] = reproc::run(args, options);
 
     if (ec)
-        return -1;
+        return std::unexpected(std::format("Failed to run {}: {}", args.front(), ec.message()));
     return status;
 }
+#endif
 } // namespace catalyst
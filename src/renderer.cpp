@@ -0,0 +1,248 @@
+#include "cbe/renderer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace catalyst {
+
+namespace {
+
+constexpr auto TUNABLE__render_interval = std::chrono::milliseconds(50);
+constexpr size_t TUNABLE__default_width = 80;
+
+bool stdout_is_tty() {
+#ifdef _WIN32
+    return _isatty(_fileno(stdout)) != 0;
+#else
+    return isatty(STDOUT_FILENO) != 0;
+#endif
+}
+
+size_t terminal_width() {
+#ifndef _WIN32
+    winsize size{};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0)
+        return size.ws_col;
+#endif
+    return TUNABLE__default_width;
+}
+
+/** @brief `m:ss`, or `h:mm:ss` from an hour on. */
+std::string format_duration(std::chrono::seconds duration) {
+    const auto total = duration.count();
+    if (total >= 3600)
+        return std::format("{}:{:02}:{:02}", total / 3600, total / 60 % 60, total % 60);
+    return std::format("{}:{:02}", total / 60, total % 60);
+}
+
+} // namespace
+
+Renderer::Mode Renderer::detect_mode() {
+    if (!stdout_is_tty())
+        return Mode::LINES;
+    const char *term = std::getenv("TERM");
+    if (term != nullptr && std::string_view(term) == "dumb")
+        return Mode::LINES;
+    return Mode::STATUS;
+}
+
+Renderer::Renderer(Mode mode, size_t total_steps, size_t total_cost, bool dry_run)
+    : mode_(dry_run ? Mode::LINES : mode), total_steps_(total_steps), total_cost_(total_cost), dry_run_(dry_run),
+      begin_(std::chrono::steady_clock::now()), thread_([this] { render_loop(); }) {
+}
+
+Renderer::~Renderer() {
+    stop();
+}
+
+void Renderer::push(Event *event) {
+    event->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(event->next, event, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+void Renderer::started(std::string_view tool, std::string_view output) {
+    push(new Event{.kind = Kind::STARTED, .tool = tool, .output = output});
+}
+
+void Renderer::finished(size_t cost, bool ok) {
+    push(new Event{.kind = Kind::FINISHED, .cost = cost, .ok = ok});
+}
+
+void Renderer::skipped(std::string_view tool, std::string_view output, size_t cost) {
+    push(new Event{.kind = Kind::SKIPPED, .cost = cost, .tool = tool, .output = output});
+}
+
+void Renderer::message(std::string text, bool error) {
+    push(new Event{.kind = error ? Kind::ERROR : Kind::MESSAGE, .text = std::move(text)});
+}
+
+void Renderer::stop() {
+    {
+        std::lock_guard lock(stop_mtx_);
+        if (stopping_)
+            return;
+        stopping_ = true;
+    }
+    stop_cv_.notify_one();
+    thread_.join();
+}
+
+void Renderer::render_loop() {
+    std::unique_lock lock(stop_mtx_);
+    while (!stopping_) {
+        stop_cv_.wait_for(lock, TUNABLE__render_interval);
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+    lock.unlock();
+
+    drain();
+    if (status_shown_) {
+        std::fputc('\n', stdout);
+        std::fflush(stdout);
+    }
+}
+
+void Renderer::drain() {
+    // The stack holds the newest event first; reverse it to print in order.
+    Event *fifo = nullptr;
+    for (Event *event = head_.exchange(nullptr, std::memory_order_acquire); event != nullptr;) {
+        Event *next = event->next;
+        event->next = fifo;
+        fifo = event;
+        event = next;
+    }
+
+    std::string out;
+    auto flush = [&] {
+        if (out.empty())
+            return;
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+        out.clear();
+    };
+    // Messages get their own lines above the status line, which is redrawn below them.
+    auto clear_status = [&] {
+        if (status_shown_) {
+            out += "\r\033[K";
+            status_shown_ = false;
+        }
+    };
+
+    while (fifo != nullptr) {
+        std::unique_ptr<Event> event(fifo);
+        fifo = event->next;
+        switch (event->kind) {
+        case Kind::STARTED:
+            launched_++;
+            last_tool_ = event->tool;
+            last_output_ = event->output;
+            if (mode_ == Mode::LINES) {
+                if (dry_run_)
+                    out += "[DRY RUN] ";
+                else
+                    std::format_to(std::back_inserter(out), "[{}/{}] ", launched_, total_steps_);
+                std::format_to(std::back_inserter(out), "{:>3} -> {}\n", event->tool, event->output);
+            }
+            break;
+        case Kind::FINISHED:
+            finished_++;
+            finished_cost_ += event->cost;
+            failed_ |= !event->ok;
+            break;
+        case Kind::SKIPPED:
+            // Both counters move, so the running count and `[n/N]` still add up.
+            launched_++;
+            finished_++;
+            finished_cost_ += event->cost;
+            if (mode_ == Mode::LINES) {
+                std::format_to(std::back_inserter(out),
+                               "[{}/{}] {:>3} -> {} (skipped)\n",
+                               launched_,
+                               total_steps_,
+                               event->tool,
+                               event->output);
+            }
+            break;
+        case Kind::MESSAGE:
+            clear_status();
+            out += event->text;
+            out += '\n';
+            break;
+        case Kind::ERROR:
+            clear_status();
+            flush();
+            std::fputs(event->text.c_str(), stderr);
+            std::fputc('\n', stderr);
+            break;
+        }
+    }
+
+    if (mode_ == Mode::STATUS && launched_ != 0) {
+        width_ = terminal_width();
+        append_status(out);
+        status_shown_ = true;
+    }
+    flush();
+}
+
+void Renderer::append_status(std::string &out) const {
+    const std::string counter = std::format("[{}/{}]", finished_, total_steps_);
+    const auto elapsed = std::chrono::steady_clock::now() - begin_;
+    if (finished_ == total_steps_ && !failed_) {
+        std::format_to(std::back_inserter(out),
+                       "\r\033[1m{}\033[0m done in {}\033[K",
+                       counter,
+                       format_duration(std::chrono::duration_cast<std::chrono::seconds>(elapsed)));
+        return;
+    }
+
+    // The work still ahead, scaled by how fast the work behind us went. Estimates are
+    // relative, so this also corrects for the number of jobs and the machine's speed.
+    std::string eta = "--:--";
+    if (finished_cost_ != 0) {
+        const size_t remaining = total_cost_ - std::min(finished_cost_, total_cost_);
+        const auto ahead = elapsed * static_cast<double>(remaining) / static_cast<double>(finished_cost_);
+        eta = format_duration(std::chrono::duration_cast<std::chrono::seconds>(ahead));
+    }
+    std::string details = std::format(" {} running, ETA {} | {:>3} -> ", launched_ - finished_, eta, last_tool_);
+
+    // Never wrap: a wrapped line cannot be rewritten with a carriage return. Long
+    // outputs keep their tail, which is the part that tells them apart.
+    std::string_view output = last_output_;
+    const size_t used = counter.size() + details.size();
+    const size_t room = width_ > used + 1 ? width_ - used - 1 : 0;
+    std::string elided;
+    if (output.size() > room) {
+        if (room > 3)
+            elided = std::format("...{}", output.substr(output.size() - (room - 3)));
+        output = elided;
+    }
+    if (used >= width_) {
+        details.clear();
+        output = {};
+    }
+
+    std::format_to(std::back_inserter(out), "\r\033[1m{}\033[0m{}{}\033[K", counter, details, output);
+}
+
+} // namespace catalyst
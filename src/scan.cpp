@@ -0,0 +1,136 @@
+#include "cbe/scan.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CBE_SCAN_X86 1
+#include <immintrin.h>
+#else
+#define CBE_SCAN_X86 0
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+namespace catalyst {
+
+namespace {
+
+using Kernel = size_t (*)(const char *data, size_t size, size_t pos);
+
+bool is_pipe_or_newline(char c) {
+    return c == '|' || c == '\n';
+}
+
+bool is_depfile_break(char c) {
+    return static_cast<unsigned char>(c) <= ' ' || c == '\\';
+}
+
+template <bool (*Match)(char)> size_t scan_scalar(const char *data, size_t size, size_t pos) {
+    while (pos < size && !Match(data[pos]))
+        pos++;
+    return pos;
+}
+
+#if CBE_SCAN_X86
+
+// Both kernels build a byte mask of matches per block; the first set bit is the answer.
+// The tail shorter than a block is finished by the scalar loop.
+
+size_t pipe_or_newline_sse2(const char *data, size_t size, size_t pos) {
+    const __m128i pipe = _mm_set1_epi8('|');
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        auto mask = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, pipe), _mm_cmpeq_epi8(block, newline))));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+    }
+    return scan_scalar<is_pipe_or_newline>(data, size, pos);
+}
+
+size_t depfile_break_sse2(const char *data, size_t size, size_t pos) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        // Unsigned `block <= ' '` is `min(block, ' ') == block`.
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(block, space), block);
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(control, _mm_cmpeq_epi8(block, backslash))));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+    }
+    return scan_scalar<is_depfile_break>(data, size, pos);
+}
+
+__attribute__((target("avx2"))) size_t pipe_or_newline_avx2(const char *data, size_t size, size_t pos) {
+    const __m256i pipe = _mm256_set1_epi8('|');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, pipe), _mm256_cmpeq_epi8(block, newline))));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+    }
+    return pipe_or_newline_sse2(data, size, pos);
+}
+
+__attribute__((target("avx2"))) size_t depfile_break_avx2(const char *data, size_t size, size_t pos) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(block, space), block);
+        auto mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_or_si256(control, _mm256_cmpeq_epi8(block, backslash))));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+    }
+    return depfile_break_sse2(data, size, pos);
+}
+
+#endif
+
+struct Kernels {
+    Kernel pipe_or_newline;
+    Kernel depfile_break;
+    std::string_view name;
+};
+
+Kernels select_kernels() {
+#if CBE_SCAN_X86
+    // SSE2 is part of x86-64, so only AVX2 needs a runtime check.
+    if (__builtin_cpu_supports("avx2"))
+        return {.pipe_or_newline = pipe_or_newline_avx2, .depfile_break = depfile_break_avx2, .name = "avx2"};
+    return {.pipe_or_newline = pipe_or_newline_sse2, .depfile_break = depfile_break_sse2, .name = "sse2"};
+#else
+    return {.pipe_or_newline = scan_scalar<is_pipe_or_newline>,
+            .depfile_break = scan_scalar<is_depfile_break>,
+            .name = "scalar"};
+#endif
+}
+
+const Kernels &kernels() {
+    static const Kernels selected = select_kernels();
+    return selected;
+}
+
+} // namespace
+
+size_t find_pipe_or_newline(std::string_view text, size_t pos) {
+    return kernels().pipe_or_newline(text.data(), text.size(), pos);
+}
+
+size_t find_depfile_break(std::string_view text, size_t pos) {
+    return kernels().depfile_break(text.data(), text.size(), pos);
+}
+
+std::string_view scan_kernel_name() {
+    return kernels().name;
+}
+
+} // namespace catalyst
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
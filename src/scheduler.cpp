@@ -0,0 +1,360 @@
+#include "cbe/scheduler.hpp"
+
+#include "cbe/jobserver.hpp"
+#include "cbe/utility.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+namespace catalyst {
+
+Scheduler::Scheduler(const Dag &dag, size_t num_workers, const Resources &resources)
+    : dag_(dag), num_tasks_(dag.offsets.empty() ? 0 : dag.offsets.size() - 1),
+      num_workers_(std::max<size_t>(1, num_workers)),
+      in_degrees_(std::make_unique<std::atomic<uint32_t>[]>(num_tasks_)),
+      queues_(std::make_unique<WorkerQueue[]>(num_workers_)), resources_(resources),
+      resource_states_(std::make_unique<ResourceState[]>(resources.capacities.size())) {
+    for (uint32_t succ : dag_.successors) {
+        in_degrees_[succ].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto priority = [&](uint32_t task) -> size_t { return dag_.priorities.empty() ? 0 : dag_.priorities[task]; };
+
+    // Deal the roots out in priority order so every worker starts on high-priority work.
+    std::vector<Entry> roots;
+    for (uint32_t task = 0; task < num_tasks_; ++task) {
+        if (in_degrees_[task].load(std::memory_order_relaxed) == 0) {
+            roots.push_back({.priority = priority(task), .task = task});
+        }
+    }
+    std::ranges::sort(roots, [](const Entry &a, const Entry &b) { return b < a; });
+    for (size_t i = 0; i < roots.size(); ++i) {
+        queues_[i % num_workers_].heap.push_back(roots[i]);
+    }
+    for (size_t w = 0; w < num_workers_; ++w) {
+        auto &queue = queues_[w];
+        std::make_heap(queue.heap.begin(), queue.heap.end());
+        queue.size.store(queue.heap.size(), std::memory_order_relaxed);
+    }
+    in_flight_.store(roots.size());
+}
+
+Scheduler::~Scheduler() = default;
+
+void Scheduler::push(size_t worker, uint32_t task) {
+    auto &queue = queues_[worker];
+    size_t priority = dag_.priorities.empty() ? 0 : dag_.priorities[task];
+    std::lock_guard lock(queue.mtx);
+    queue.heap.push_back({.priority = priority, .task = task});
+    std::push_heap(queue.heap.begin(), queue.heap.end());
+    queue.size.store(queue.heap.size(), std::memory_order_release);
+}
+
+std::optional<uint32_t> Scheduler::pop_local(size_t worker) {
+    auto &queue = queues_[worker];
+    std::lock_guard lock(queue.mtx);
+    if (queue.heap.empty())
+        return std::nullopt;
+    std::pop_heap(queue.heap.begin(), queue.heap.end());
+    uint32_t task = queue.heap.back().task;
+    queue.heap.pop_back();
+    queue.size.store(queue.heap.size(), std::memory_order_release);
+    return task;
+}
+
+std::optional<uint32_t> Scheduler::steal(size_t thief) {
+    for (size_t k = 1; k < num_workers_; ++k) {
+        size_t victim = (thief + k) % num_workers_;
+        if (queues_[victim].size.load(std::memory_order_acquire) == 0)
+            continue;
+        if (auto task = pop_local(victim))
+            return task;
+    }
+    return std::nullopt;
+}
+
+std::optional<uint32_t> Scheduler::find_task(size_t worker) {
+    for (;;) {
+        auto task = pop_local(worker);
+        if (!task)
+            task = steal(worker);
+        // A task that does not fit now waits on a resource; look for another.
+        if (!task || admit(*task))
+            return task;
+    }
+}
+
+std::span<const Scheduler::Demand> Scheduler::demands_of(uint32_t task) const {
+    if (resources_.offsets.empty())
+        return {};
+    return resources_.demands.subspan(resources_.offsets[task],
+                                      resources_.offsets[task + 1] - resources_.offsets[task]);
+}
+
+bool Scheduler::admit(uint32_t task) {
+    const auto demands = demands_of(task);
+    if (demands.empty())
+        return true;
+
+    // Demands are sorted by resource, so the locks are always taken in the same order.
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(demands.size());
+    for (const Demand &demand : demands) {
+        ResourceState &state = resource_states_[demand.resource];
+        locks.emplace_back(state.mtx);
+        if (state.used != 0 && state.used + demand.amount > resources_.capacities[demand.resource]) {
+            // Something holds this resource, so a later release is guaranteed to retry us.
+            state.waiting.push_back({.priority = dag_.priorities.empty() ? 0 : dag_.priorities[task], .task = task});
+            std::push_heap(state.waiting.begin(), state.waiting.end());
+            return false;
+        }
+    }
+    for (const Demand &demand : demands)
+        resource_states_[demand.resource].used += demand.amount;
+    return true;
+}
+
+size_t Scheduler::release(size_t worker, uint32_t task) {
+    size_t requeued = 0;
+    for (const Demand &demand : demands_of(task)) {
+        ResourceState &state = resource_states_[demand.resource];
+        const size_t capacity = resources_.capacities[demand.resource];
+        std::lock_guard lock(state.mtx);
+        state.used -= demand.amount;
+        // Hand back as many waiters as look like they fit; admission checks them again.
+        size_t promised = state.used;
+        while (!state.waiting.empty()) {
+            const uint32_t waiter = state.waiting.front().task;
+            size_t amount = 0;
+            for (const Demand &d : demands_of(waiter)) {
+                if (d.resource == demand.resource)
+                    amount = d.amount;
+            }
+            if (promised != 0 && promised + amount > capacity)
+                break;
+            std::pop_heap(state.waiting.begin(), state.waiting.end());
+            state.waiting.pop_back();
+            // Still counted in in_flight_ from when it was first released.
+            push(worker, waiter);
+            promised += std::max<size_t>(amount, 1);
+            requeued++;
+        }
+    }
+    return requeued;
+}
+
+void Scheduler::complete(size_t worker, uint32_t task) {
+    size_t released = release(worker, task);
+    for (uint32_t i = dag_.offsets[task]; i < dag_.offsets[task + 1]; ++i) {
+        uint32_t succ = dag_.successors[i];
+        if (in_degrees_[succ].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            // Counted before this task leaves in_flight_, so it never reads 0 spuriously.
+            in_flight_.fetch_add(1);
+            push(worker, succ);
+            released++;
+        }
+    }
+
+    if (completed_.fetch_add(1) + 1 == num_tasks_) {
+        done_.store(true);
+    }
+    in_flight_.fetch_sub(1);
+
+    if (done_.load()) {
+        wake_all();
+        return;
+    }
+
+    // This worker picks up one of the released tasks itself; wake others for the rest.
+    if (released > 1) {
+        wake_epoch_.fetch_add(1);
+        size_t parked = parked_.load();
+        for (size_t i = 1; i < released && i <= parked; ++i) {
+            wake_epoch_.notify_one();
+        }
+    }
+}
+
+void Scheduler::wake_all() {
+    wake_epoch_.fetch_add(1);
+    wake_epoch_.notify_all();
+}
+
+void Scheduler::worker_loop(size_t worker, const TaskFn &task_fn) {
+    while (!failed_.load() && !done_.load() && !stalled_.load()) {
+        auto task = find_task(worker);
+        if (!task) {
+            // Read the epoch before the final check: any push after this point bumps it,
+            // so the wait below cannot miss a wakeup.
+            uint32_t epoch = wake_epoch_.load();
+            task = find_task(worker);
+            if (!task) {
+                if (failed_.load() || done_.load() || stalled_.load())
+                    return;
+                if (in_flight_.load() == 0) {
+                    // Nothing queued, nothing running, work left over: a cycle.
+                    stalled_.store(true);
+                    wake_all();
+                    return;
+                }
+                parked_.fetch_add(1);
+                wake_epoch_.wait(epoch);
+                parked_.fetch_sub(1);
+                continue;
+            }
+        }
+
+        if (!task_fn(*task)) {
+            failed_.store(true);
+            wake_all();
+            return;
+        }
+        complete(worker, *task);
+    }
+}
+
+Result<void> Scheduler::run(const TaskFn &task_fn) {
+    if (num_tasks_ == 0)
+        return {};
+
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(num_workers_);
+        for (size_t w = 0; w < num_workers_; ++w) {
+            workers.emplace_back([this, w, &task_fn] { worker_loop(w, task_fn); });
+        }
+    } // Join all threads
+
+    if (failed_.load())
+        return std::unexpected("Build Failed");
+
+    if (completed_.load() != num_tasks_)
+        return std::unexpected("Cycle detected: Build stalled with pending nodes.");
+
+    return {};
+}
+
+#ifdef __linux__
+Result<void> Scheduler::run_reactor(size_t max_running,
+                                    const StartFn &start_fn,
+                                    const FinishFn &finish_fn,
+                                    Jobserver *jobserver) {
+    if (num_tasks_ == 0)
+        return {};
+
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+        return std::unexpected(std::format("Failed to create epoll instance: {}", std::strerror(errno)));
+
+    // Task data always fits in 32 bits, so this cannot collide with a task's event.
+    constexpr uint64_t jobserver_event = UINT64_MAX;
+    bool jobserver_armed = false;
+    size_t tokens = 0;
+
+    max_running = std::max<size_t>(1, max_running);
+    std::vector<epoll_event> events(max_running + 1);
+    size_t running = 0;
+    bool failed = false;
+    for (;;) {
+        // Fill every free slot. Tasks that finish on the spot release their dependents
+        // right away, so they are picked up in the same pass.
+        bool need_token = false;
+        while (!failed && running < max_running) {
+            // The implicit slot covers one running task; each further one holds a token.
+            const bool take_token = jobserver != nullptr && running > tokens;
+            if (take_token) {
+                // A token is only worth taking for a task that is ready.
+                if (queues_[0].size.load(std::memory_order_acquire) == 0)
+                    break;
+                if (!jobserver->try_acquire()) {
+                    need_token = true;
+                    break;
+                }
+                tokens++;
+            }
+            auto task = find_task(0);
+            if (!task)
+                break;
+            const Started started = start_fn(*task);
+            if (!started.ok) {
+                failed = true;
+            } else if (started.fd < 0) {
+                complete(0, *task);
+            } else {
+                // The fd and the task share the event's 64 bits of user data.
+                epoll_event event{.events = EPOLLIN,
+                                  .data = {.u64 = (uint64_t{static_cast<uint32_t>(started.fd)} << 32) | *task}};
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, started.fd, &event) < 0) {
+                    // Cannot be watched: wait for it here instead.
+                    if (finish_fn(*task))
+                        complete(0, *task);
+                    else
+                        failed = true;
+                } else {
+                    running++;
+                }
+            }
+        }
+        // Keep a token only for a task that is running.
+        while (tokens > 0 && tokens >= running) {
+            jobserver->release();
+            tokens--;
+        }
+        // Nothing running and nothing startable: finished, failed or stalled.
+        if (running == 0)
+            break;
+
+        if (need_token) {
+            // One-shot, so an idle jobserver does not wake us while we have all we need.
+            epoll_event event{.events = EPOLLIN | EPOLLONESHOT, .data = {.u64 = jobserver_event}};
+            if (epoll_ctl(epoll_fd, jobserver_armed ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, jobserver->fd(), &event) == 0)
+                jobserver_armed = true;
+        }
+
+        const int count = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            close(epoll_fd);
+            return std::unexpected(std::format("Failed to wait for running steps: {}", std::strerror(errno)));
+        }
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.u64 == jobserver_event)
+                continue; // Retried by the next fill.
+            const auto fd = static_cast<int>(events[i].data.u64 >> 32);
+            const auto task = static_cast<uint32_t>(events[i].data.u64);
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            running--;
+            if (finish_fn(task))
+                complete(0, task);
+            else
+                failed = true;
+        }
+    }
+    close(epoll_fd);
+
+    if (failed)
+        return std::unexpected("Build Failed");
+
+    if (completed_.load() != num_tasks_)
+        return std::unexpected("Cycle detected: Build stalled with pending nodes.");
+
+    return {};
+}
+#endif
+
+} // namespace catalyst
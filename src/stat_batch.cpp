@@ -0,0 +1,315 @@
+#include "cbe/stat_batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+namespace catalyst {
+
+namespace {
+
+/**
+ * @brief Copies the paths into one NUL-terminated arena, since graph strings are
+ * views into mmaps and are not terminated.
+ */
+class CStringArena {
+public:
+    explicit CStringArena(std::span<const std::string_view> paths) {
+        size_t total = 0;
+        for (auto p : paths)
+            total += p.size() + 1;
+        data_.reserve(total);
+        offsets_.reserve(paths.size());
+        for (auto p : paths) {
+            offsets_.push_back(data_.size());
+            data_.append(p);
+            data_.push_back('\0');
+        }
+    }
+
+    const char *operator[](size_t i) const {
+        return data_.data() + offsets_[i];
+    }
+
+private:
+    std::string data_;
+    std::vector<size_t> offsets_;
+};
+
+#ifdef __linux__
+
+std::filesystem::file_time_type to_file_time(const struct statx_timestamp &ts) {
+    auto since_epoch = std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    auto sys = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch));
+    return std::chrono::file_clock::from_sys(sys);
+}
+
+StatResult to_result(int err, const struct statx &buf) {
+    if (err != 0)
+        return {.time = std::filesystem::file_time_type::min(), .ec = std::error_code(err, std::generic_category())};
+    return {.time = to_file_time(buf.stx_mtime), .ec = {}, .size = buf.stx_size, .inode = buf.stx_ino};
+}
+
+constexpr unsigned statx_mask = STATX_MTIME | STATX_SIZE | STATX_INO;
+
+/** @brief Minimal raw-syscall io_uring, just enough to submit batches of STATX. */
+class StatxRing {
+public:
+    static constexpr unsigned TUNABLE__ring_entries = 256;
+
+    StatxRing() {
+        io_uring_params params{};
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, TUNABLE__ring_entries, &params));
+        if (fd < 0)
+            return;
+        fd_ = fd;
+
+        sq_ring_size_ = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+        cq_ring_size_ = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+        single_mmap_ = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap_)
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+        sq_ring_ =
+            mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            sq_ring_ = nullptr;
+            return;
+        }
+        if (single_mmap_) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(
+                nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                cq_ring_ = nullptr;
+                return;
+            }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return;
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+        auto *sq = static_cast<char *>(sq_ring_);
+        auto *cq = static_cast<char *>(cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        capacity_ = std::min(params.sq_entries, params.cq_entries);
+    }
+
+    ~StatxRing() {
+        if (sqes_)
+            munmap(sqes_, sqes_size_);
+        if (cq_ring_ && !single_mmap_)
+            munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_)
+            munmap(sq_ring_, sq_ring_size_);
+        if (fd_ != -1)
+            close(fd_);
+    }
+
+    StatxRing(const StatxRing &) = delete;
+    StatxRing &operator=(const StatxRing &) = delete;
+
+    bool ok() const {
+        return sqes_ != nullptr;
+    }
+
+    /**
+     * @brief Stats every path, writing into `bufs` and `errs`.
+     * @return False if the kernel rejected the opcode or the ring failed; callers should fall
+     * back. Either way no request is in flight any more, so `bufs` may be reused or freed.
+     */
+    bool run(const CStringArena &paths,
+             size_t count,
+             std::span<struct statx> bufs,
+             std::span<int> errs,
+             StatBatchReport &report) {
+        size_t next = 0;
+        while (next < count) {
+            const auto batch = static_cast<unsigned>(std::min<size_t>(capacity_, count - next));
+
+            unsigned tail = *sq_tail_;
+            for (unsigned i = 0; i < batch; ++i) {
+                size_t idx = next + i;
+                unsigned slot = tail & sq_mask_;
+                io_uring_sqe &sqe = sqes_[slot];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_STATX;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(paths[idx]);
+                sqe.len = statx_mask;
+                sqe.off = reinterpret_cast<uint64_t>(&bufs[idx]);
+                sqe.user_data = idx;
+                sq_array_[slot] = slot;
+                tail++;
+            }
+            std::atomic_ref(*sq_tail_).store(tail, std::memory_order_release);
+
+            // The kernel skips the wait on a short submission, so asking for the whole
+            // remainder of the batch cannot block forever. After a failure nothing more is
+            // submitted, but the requests in flight are still reaped: until they complete,
+            // io-wq workers may write into `bufs`.
+            unsigned submitted = 0;
+            unsigned reaped = 0;
+            bool failed = false;
+            while (reaped < (failed ? submitted : batch)) {
+                const unsigned to_submit = failed ? 0 : batch - submitted;
+                const unsigned to_wait = (failed ? submitted : batch) - reaped;
+                long ret = syscall(__NR_io_uring_enter, fd_, to_submit, to_wait, IORING_ENTER_GETEVENTS, nullptr, 0);
+                report.syscalls++;
+                if (ret >= 0) {
+                    submitted += static_cast<unsigned>(ret);
+                } else if (errno != EINTR) {
+                    // If even waiting fails, the completions are still posted to the ring.
+                    if (failed)
+                        std::this_thread::yield();
+                    failed = true;
+                }
+
+                unsigned head = std::atomic_ref(*cq_head_).load(std::memory_order_relaxed);
+                unsigned cq_tail = std::atomic_ref(*cq_tail_).load(std::memory_order_acquire);
+                for (; head != cq_tail; ++head, ++reaped) {
+                    const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                    if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+                        failed = true; // Kernel predates IORING_OP_STATX.
+                    else
+                        errs[cqe.user_data] = cqe.res < 0 ? -cqe.res : 0;
+                }
+                std::atomic_ref(*cq_head_).store(head, std::memory_order_release);
+            }
+            if (failed)
+                return false;
+            next += batch;
+        }
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+    bool single_mmap_ = false;
+    void *sq_ring_ = nullptr;
+    void *cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned cq_mask_ = 0;
+    unsigned capacity_ = 0;
+};
+
+#endif
+
+} // namespace
+
+std::vector<StatResult> stat_batch(std::span<const std::string_view> paths, size_t threads, StatBatchReport *report) {
+    StatBatchReport local_report;
+    StatBatchReport &rep = report ? *report : local_report;
+    rep = {.paths = paths.size(), .syscalls = 0, .io_uring = false};
+
+    std::vector<StatResult> results(paths.size());
+    if (paths.empty())
+        return results;
+
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::clamp<size_t>(threads, 1, paths.size());
+
+#ifdef __linux__
+    CStringArena arena(paths);
+    std::vector<struct statx> bufs(paths.size());
+    std::vector<int> errs(paths.size(), 0);
+
+    {
+        StatxRing ring;
+        if (ring.ok() && ring.run(arena, paths.size(), bufs, errs, rep)) {
+            rep.io_uring = true;
+            for (size_t i = 0; i < paths.size(); ++i)
+                results[i] = to_result(errs[i], bufs[i]);
+            return results;
+        }
+    }
+
+    // Fallback: plain statx spread over a few threads.
+    rep.syscalls = paths.size();
+    {
+        std::vector<std::jthread> pool;
+        pool.reserve(threads);
+        for (size_t t = 0; t < threads; ++t) {
+            pool.emplace_back([&, t] {
+                for (size_t i = t; i < paths.size(); i += threads) {
+                    int err = statx(AT_FDCWD, arena[i], 0, statx_mask, &bufs[i]) == 0 ? 0 : errno;
+                    results[i] = to_result(err, bufs[i]);
+                }
+            });
+        }
+    }
+#else
+    rep.syscalls = paths.size();
+    {
+        std::vector<std::jthread> pool;
+        pool.reserve(threads);
+        for (size_t t = 0; t < threads; ++t) {
+            pool.emplace_back([&, t] {
+                for (size_t i = t; i < paths.size(); i += threads) {
+                    auto &res = results[i];
+                    res.time = std::filesystem::last_write_time(std::filesystem::path(paths[i]), res.ec);
+                }
+            });
+        }
+    }
+#endif
+    return results;
+}
+
+StatResult stat_one(std::string_view path) {
+#ifdef __linux__
+    const std::string c_path(path);
+    struct statx buf {};
+    const int err = statx(AT_FDCWD, c_path.c_str(), 0, statx_mask, &buf) == 0 ? 0 : errno;
+    return to_result(err, buf);
+#else
+    StatResult res;
+    res.time = std::filesystem::last_write_time(std::filesystem::path(path), res.ec);
+    return res;
+#endif
+}
+
+} // namespace catalyst
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
@@ -1,15 +1,26 @@
 #include "cbe/work_estimate.hpp"
 
 #include "cbe/mmap.hpp"
+#include "cbe/utility.hpp"
 
 #include <charconv>
 #include <cstddef>
 #include <filesystem>
+#include <format>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
 using namespace catalyst;
 
-catalyst::WorkEstimate::WorkEstimate(const std::filesystem::path &path_to_estimates) {
+namespace {
+// Weight (in percent) given to a new measurement in the moving average.
+constexpr size_t TUNABLE__ema_sample_weight = 30;
+} // namespace
+
+catalyst::WorkEstimate::WorkEstimate(const std::filesystem::path &path_to_estimates)
+    : estimates_path(path_to_estimates) {
     try {
         estimates_file_keep_alive = std::make_shared<MappedFile>(path_to_estimates);
         std::string_view content = estimates_file_keep_alive->content();
@@ -41,3 +52,52 @@ catalyst::WorkEstimate::WorkEstimate(const std::filesystem::path &path_to_estima
     } catch (const std::runtime_error &) {
     }
 }
+
+void catalyst::WorkEstimate::record(std::string_view path, size_t measured_ms) {
+    // `estimates` is never mutated after construction, so reading it here is safe.
+    size_t previous = get_work_estimate(path);
+    size_t updated = measured_ms;
+    if (previous != 0) {
+        updated = (TUNABLE__ema_sample_weight * measured_ms + (100 - TUNABLE__ema_sample_weight) * previous) / 100;
+    }
+    // Never learn a zero: it is indistinguishable from "unknown".
+    if (updated == 0)
+        updated = 1;
+
+    std::lock_guard lock(learned_mtx);
+    learned.insert_or_assign(std::string(path), updated);
+}
+
+Result<void> catalyst::WorkEstimate::save() {
+    std::lock_guard lock(learned_mtx);
+    if (learned.empty())
+        return {};
+
+    auto tmp_path = estimates_path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        if (!out) {
+            return std::unexpected(std::format("Failed to open {} for writing", tmp_path.string()));
+        }
+        // Keep estimates for steps that did not run this time.
+        for (const auto &[path, estimate] : estimates) {
+            if (!learned.contains(std::string(path))) {
+                out << path << '|' << estimate << '\n';
+            }
+        }
+        for (const auto &[path, estimate] : learned) {
+            out << path << '|' << estimate << '\n';
+        }
+        if (!out) {
+            return std::unexpected(std::format("Failed to write {}", tmp_path.string()));
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, estimates_path, ec);
+    if (ec) {
+        return std::unexpected(std::format("Failed to replace {}: {}", estimates_path.string(), ec.message()));
+    }
+    return {};
+}
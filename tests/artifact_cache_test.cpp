@@ -0,0 +1,159 @@
+#include "tests/test_suite.hpp"
+#include "tests/testing_utils.hpp"
+
+#include "cbe/artifact_cache.hpp"
+#include "cbe/hash.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+
+using namespace catalyst;
+
+namespace {
+
+std::string read_file(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+/** @brief Incompressible bytes, so every entry stored from them takes about the same space. */
+std::string random_bytes(size_t size, uint32_t seed) {
+    std::mt19937 gen(seed);
+    std::string out(size, '\0');
+    for (auto &c : out)
+        c = static_cast<char>(gen());
+    return out;
+}
+
+uint64_t directory_size(const std::filesystem::path &dir) {
+    uint64_t total = 0;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(dir))
+        if (entry.is_regular_file())
+            total += entry.file_size();
+    return total;
+}
+
+bool has_files(const std::filesystem::path &dir) {
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(dir, ec))
+        if (entry.is_regular_file())
+            return true;
+    return false;
+}
+
+bool check_round_trip() {
+    const std::string object = random_bytes(4096, 1);
+    const Digest key{.low = 1, .high = 2};
+    write_file("dep.h", "#define V 1\n");
+    write_file("out.o", object);
+    write_file("out.d", "out.o: dep.h\n");
+    std::filesystem::permissions("out.o", std::filesystem::perms::owner_exec, std::filesystem::perm_options::add);
+    const auto perms = std::filesystem::status("out.o").permissions();
+
+    ArtifactCache cache("cache", UINT64_MAX);
+    if (auto res = cache.store(key, "out.o", "out.d"); !res) {
+        std::println(std::cerr, "Store failed: {}", res.error());
+        return false;
+    }
+    if (!has_files("cache/manifests") || !has_files("cache/objects")) {
+        std::println(std::cerr, "Store did not write both a manifest and an object");
+        return false;
+    }
+
+    std::filesystem::remove("out.o");
+    std::filesystem::remove("out.d");
+    if (cache.restore({.low = 3, .high = 4}, "out.o", "out.d") || std::filesystem::exists("out.o")) {
+        std::println(std::cerr, "An unknown key was restored");
+        return false;
+    }
+    if (!cache.restore(key, "out.o", "out.d")) {
+        std::println(std::cerr, "A stored entry was not restored");
+        return false;
+    }
+    if (read_file("out.o") != object || read_file("out.d") != "out.o: dep.h\n" ||
+        std::filesystem::status("out.o").permissions() != perms) {
+        std::println(std::cerr, "The restored files differ from the stored ones");
+        return false;
+    }
+    // Without a depfile the object cannot be used for a step that writes one, and vice versa.
+    if (cache.restore(key, "out.o", std::nullopt)) {
+        std::println(std::cerr, "An entry with a depfile was restored without one");
+        return false;
+    }
+
+    // The manifest still names dep.h, whose new contents lead to a different object.
+    write_file("dep.h", "#define V 2\n");
+    if (cache.restore(key, "out.o", "out.d")) {
+        std::println(std::cerr, "An entry was restored after its dependency changed");
+        return false;
+    }
+    if (cache.hits() != 1 || cache.misses() != 3) {
+        std::println(std::cerr, "Counted {} hits and {} misses, expected 1 and 3", cache.hits(), cache.misses());
+        return false;
+    }
+    return true;
+}
+
+bool check_trim() {
+    std::filesystem::remove_all("cache");
+    const Digest keys[] = {{.low = 10}, {.low = 11}, {.low = 12}};
+    auto store = [&](ArtifactCache &cache, size_t i) {
+        write_file("out.o", random_bytes(4096, static_cast<uint32_t>(i)));
+        return cache.store(keys[i], "out.o", std::nullopt).has_value();
+    };
+
+    // Measure one entry, then budget for fewer than three but, after trimming to 90%, at least two.
+    uint64_t entry_size = 0;
+    {
+        ArtifactCache probe("cache", UINT64_MAX);
+        if (!store(probe, 0))
+            return false;
+        entry_size = directory_size("cache");
+        std::filesystem::remove_all("cache");
+    }
+    const uint64_t budget = entry_size * 27 / 10;
+
+    ArtifactCache cache("cache", budget);
+    for (size_t i = 0; i < 3; ++i) {
+        if (!store(cache, i)) {
+            std::println(std::cerr, "Store {} failed", i);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    // Using the oldest entry makes the second one the least recently used.
+    if (!cache.restore(keys[0], "out.o", std::nullopt))
+        return false;
+    cache.trim();
+
+    if (directory_size("cache") > budget) {
+        std::println(std::cerr, "Trim left the cache over its budget");
+        return false;
+    }
+    if (!cache.restore(keys[0], "out.o", std::nullopt) || !cache.restore(keys[2], "out.o", std::nullopt) ||
+        cache.restore(keys[1], "out.o", std::nullopt)) {
+        std::println(std::cerr, "Trim did not evict exactly the least recently used entry");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool artifact_cache_test() {
+    std::println("Starting Artifact Cache Test...");
+    const bool ok = with_scratch_dir("artifact_cache_test", [] { return check_round_trip() && check_trim(); });
+    if (ok)
+        std::println("Artifact Cache Test passed!");
+    return ok;
+}
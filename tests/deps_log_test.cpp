@@ -0,0 +1,84 @@
+#include "tests/test_suite.hpp"
+
+#include "cbe/deps_log.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+
+constexpr std::string_view test_log = "deps_log_test.deps";
+
+bool expect_deps(const DepsLog &log, std::string_view output, const std::vector<std::string_view> &expected) {
+    auto deps = log.deps(output);
+    if (!deps) {
+        std::println(std::cerr, "No deps recorded for {}", output);
+        return false;
+    }
+    std::vector<std::string_view> got;
+    for (uint32_t id : *deps)
+        got.push_back(log.path(id));
+    if (got != expected) {
+        std::println(std::cerr, "Wrong deps for {} ({} recorded, {} expected)", output, got.size(), expected.size());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool deps_log_test() {
+    std::println("Starting Deps Log Test...");
+    std::filesystem::remove(test_log);
+
+    {
+        DepsLog log(test_log);
+        if (!log.open_for_append() || !log.record("a.o", std::vector<std::string_view>{"a.c", "a.h"}) ||
+            !log.record("b.o", std::vector<std::string_view>{"b.c", "a.h"}) ||
+            !log.record("a.o", std::vector<std::string_view>{"a.c"})) {
+            std::println(std::cerr, "Failed to write the deps log");
+            return false;
+        }
+    }
+
+    // Latest record wins, and paths are shared between outputs.
+    {
+        DepsLog log(test_log);
+        if (!expect_deps(log, "a.o", {"a.c"}) || !expect_deps(log, "b.o", {"b.c", "a.h"}))
+            return false;
+        if (log.deps("c.o")) {
+            std::println(std::cerr, "Deps reported for an output that was never recorded");
+            return false;
+        }
+    }
+
+    // A torn tail is ignored on load and dropped before the next append.
+    {
+        std::ofstream torn(std::string(test_log), std::ios::binary | std::ios::app);
+        torn.write("\x20\x00\x00\x80" "ab", 6);
+    }
+    {
+        DepsLog log(test_log);
+        if (!expect_deps(log, "b.o", {"b.c", "a.h"}) || !log.open_for_append() ||
+            !log.record("c.o", std::vector<std::string_view>{"c.c"})) {
+            return false;
+        }
+    }
+    {
+        DepsLog log(test_log);
+        if (!expect_deps(log, "a.o", {"a.c"}) || !expect_deps(log, "c.o", {"c.c"}))
+            return false;
+    }
+
+    std::filesystem::remove(test_log);
+    std::println("Deps Log Test passed!");
+    return true;
+}
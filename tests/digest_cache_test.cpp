@@ -0,0 +1,120 @@
+#include "tests/test_suite.hpp"
+#include "tests/testing_utils.hpp"
+
+#include "cbe/build_log.hpp"
+#include "cbe/digest_cache.hpp"
+#include "cbe/hash.hpp"
+#include "cbe/stat_batch.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <string_view>
+#include <thread>
+
+using namespace catalyst;
+
+namespace {
+
+Digest file_digest(const std::filesystem::path &path) {
+    ContentHasher hasher;
+    hasher.update_file(path);
+    return hasher.digest();
+}
+
+/** @brief Rewrites `path` in place with same-size `content`, keeping its inode and mtime. */
+void rewrite_in_place(const std::filesystem::path &path, std::string_view content) {
+    const auto time = std::filesystem::last_write_time(path);
+    write_file(path, content);
+    std::filesystem::last_write_time(path, time);
+}
+
+bool check_persistence() {
+    write_file("a.txt", "first");
+    const Digest first = file_digest("a.txt");
+    // Leaves a.txt's mtime strictly older than the table's.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    {
+        DigestCache cache("digests");
+        if (cache.digest("a.txt", stat_one("a.txt")) != first) {
+            std::println(std::cerr, "Wrong digest for a.txt");
+            return false;
+        }
+        if (auto res = cache.save(); !res) {
+            std::println(std::cerr, "Failed to save the digest table: {}", res.error());
+            return false;
+        }
+    }
+
+    // Same inode, size and mtime: a loaded table trusts its entry instead of reading the file.
+    rewrite_in_place("a.txt", "other");
+    DigestCache cache("digests");
+    if (cache.digest("a.txt", stat_one("a.txt")) != first) {
+        std::println(std::cerr, "The saved digest of a.txt was not reused");
+        return false;
+    }
+    // Any stat change is noticed.
+    write_file("a.txt", "changed");
+    if (cache.digest("a.txt", stat_one("a.txt")) != file_digest("a.txt")) {
+        std::println(std::cerr, "A changed a.txt was not rehashed");
+        return false;
+    }
+    return true;
+}
+
+bool check_racy_entry() {
+    // An mtime newer than the table stands for a file written in the tick in which it was hashed.
+    write_file("b.txt", "first");
+    std::filesystem::last_write_time("b.txt", std::filesystem::file_time_type::clock::now() + std::chrono::hours(1));
+    {
+        DigestCache cache("digests");
+        cache.digest("b.txt", stat_one("b.txt"));
+        if (!cache.save())
+            return false;
+    }
+
+    rewrite_in_place("b.txt", "other");
+    DigestCache cache("digests");
+    if (cache.digest("b.txt", stat_one("b.txt")) != file_digest("b.txt")) {
+        std::println(std::cerr, "A racily clean entry was trusted");
+        return false;
+    }
+    return true;
+}
+
+bool check_build_log() {
+    const Digest digest{.low = 0x0123456789abcdef, .high = 0xfedcba9876543210};
+    const auto built_at = std::filesystem::file_time_type::clock::now();
+    {
+        BuildLog log("build.log");
+        if (!log.open_for_append())
+            return false;
+        log.record("digested", {.command_hash = 0xabc, .inputs_digest = digest, .built_at = built_at});
+        log.record("plain", {.command_hash = 0x123, .inputs_digest = std::nullopt, .built_at = std::nullopt});
+    }
+
+    BuildLog log("build.log");
+    if (log.command_hash("digested") != 0xabc || log.inputs_digest("digested") != digest ||
+        log.built_at("digested") != built_at) {
+        std::println(std::cerr, "A record with a digest and a build time did not parse back");
+        return false;
+    }
+    if (log.command_hash("plain") != 0x123 || log.inputs_digest("plain") || log.built_at("plain")) {
+        std::println(std::cerr, "A plain record did not parse back");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool digest_cache_test() {
+    std::println("Starting Digest Cache Test...");
+    const bool ok = with_scratch_dir("digest_cache_test",
+                                     [] { return check_persistence() && check_racy_entry() && check_build_log(); });
+    if (ok)
+        std::println("Digest Cache Test passed!");
+    return ok;
+}
@@ -0,0 +1,173 @@
+#include "tests/test_suite.hpp"
+#include "tests/testing_utils.hpp"
+
+#include "cbe/build_log.hpp"
+#include "cbe/builder.hpp"
+#include "cbe/executor.hpp"
+#include "cbe/renderer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+
+// Copies its inputs to the output without '#' lines and logs the output it wrote. The pause
+// keeps the next step's output out of this one's mtime tick.
+constexpr std::string_view filter_tool = R"(#!/bin/sh
+out=
+in=
+while [ $# -gt 0 ]; do
+    if [ "$1" = -o ]; then out=$2; shift 2; else in="$in $1"; shift; fi
+done
+echo "$out" >> runs.log
+grep -hv '^#' $in > "$out"
+sleep 0.02
+exit 0
+)";
+
+std::vector<std::string> read_lines(const std::filesystem::path &path) {
+    std::vector<std::string> lines;
+    std::ifstream in(path);
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+/** @brief Runs `fn` with stdout redirected to `path`, so the renderer's output can be checked. */
+template <typename Fn> auto capture_stdout(const std::filesystem::path &path, Fn fn) {
+    std::fflush(stdout);
+    const int saved = dup(STDOUT_FILENO);
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    auto res = fn();
+    std::fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return res;
+}
+
+/**
+ * @brief Builds `src.txt -> mid (restat) -> top -> final` and returns the outputs that ran, sorted.
+ * The progress lines go to `progress.log`.
+ */
+std::optional<std::vector<std::string>> build() {
+    std::filesystem::remove("runs.log");
+    CBEBuilder builder;
+    builder.add_definition("cxx", "./filter.sh");
+    for (auto [inputs, output, restat] : {std::tuple{"src.txt", "mid", true},
+                                          std::tuple{"mid", "top", false},
+                                          std::tuple{"top", "final", false}}) {
+        if (!builder.add_step({.tool = "ld", .inputs = inputs, .output = output, .restat = restat}))
+            return std::nullopt;
+    }
+    ExecutorConfig config;
+    config.jobserver = false;
+    Executor executor(std::move(builder), config);
+    if (auto res = capture_stdout("progress.log", [&] { return executor.execute(); }); !res) {
+        std::println(std::cerr, "Build failed: {}", res.error());
+        return std::nullopt;
+    }
+
+    std::vector<std::string> runs = read_lines("runs.log");
+    std::ranges::sort(runs);
+    return runs;
+}
+
+bool expect_runs(std::string_view what, const std::vector<std::string> &expected) {
+    auto runs = build();
+    if (!runs || *runs != expected) {
+        std::println(std::cerr, "{}: {} steps ran, {} expected", what, runs ? runs->size() : 0, expected.size());
+        return false;
+    }
+    return true;
+}
+
+bool run_checks() {
+    const std::vector<std::string> all = {"final", "mid", "top"};
+    write_file("filter.sh", filter_tool);
+    std::filesystem::permissions("filter.sh", std::filesystem::perms::owner_exec, std::filesystem::perm_options::add);
+    write_file("src.txt", "# v1\nline\n");
+    if (!expect_runs("First build", all))
+        return false;
+
+    // Only a comment changes: `mid` is rebuilt byte-identical, so `top` and then `final` are skipped.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const auto top_time = std::filesystem::last_write_time("top");
+    write_file("src.txt", "# v2\nline\n");
+    if (!expect_runs("Comment edit", {"mid"}))
+        return false;
+    // Skipped steps are still counted, so the progress reaches the total.
+    const std::vector<std::string> progress = read_lines("progress.log");
+    if (progress.size() != 3 || !progress.back().starts_with("[3/3]") || !progress.back().ends_with("(skipped)")) {
+        std::println(std::cerr, "Skipped steps were not counted in the progress lines");
+        return false;
+    }
+    if (std::filesystem::last_write_time("top") != top_time) {
+        std::println(std::cerr, "A skipped output was rewritten");
+        return false;
+    }
+    // `mid` kept its old mtime; the log remembers when it was really built.
+    auto built_at = BuildLog(".catalyst.log").built_at("mid");
+    if (!built_at || *built_at <= std::filesystem::last_write_time("mid")) {
+        std::println(std::cerr, "The build time of an unchanged restat output was not recorded");
+        return false;
+    }
+    if (!expect_runs("No-op after the cutoff", {}))
+        return false;
+
+    // A real change reaches the output, so nothing is skipped.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    write_file("src.txt", "# v2\nchanged line\n");
+    if (!expect_runs("Content edit", all))
+        return false;
+    return expect_runs("No-op after the content edit", {});
+}
+
+/** @brief The status line of a build whose steps are mostly skipped never counts below zero running. */
+bool check_status_counts() {
+    capture_stdout("status.log", [] {
+        Renderer renderer(Renderer::Mode::STATUS, 3, 30);
+        renderer.started("ld", "mid");
+        renderer.finished(10);
+        renderer.skipped("ld", "top", 10);
+        // Lets a status line be drawn in the middle of the build.
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        renderer.skipped("ld", "final", 10);
+        renderer.stop();
+        return 0;
+    });
+    std::ifstream in("status.log");
+    const std::string status{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    if (!status.contains("[2/3]\033[0m 0 running") || !status.contains("[3/3]\033[0m done")) {
+        std::println(std::cerr, "The status line miscounted skipped steps");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool early_cutoff_test() {
+    std::println("Starting Early Cutoff Test...");
+    const bool ok = with_scratch_dir("early_cutoff_test", [] { return run_checks() && check_status_counts(); });
+    if (ok)
+        std::println("Early Cutoff Test passed!");
+    return ok;
+}
@@ -0,0 +1,31 @@
+#include "tests/test_suite.hpp"
+
+#include "cbe/process_exec.hpp"
+
+#include <iostream>
+#include <optional>
+#include <print>
+#include <string>
+#include <vector>
+
+using namespace catalyst;
+
+bool process_capture_test() {
+#ifdef __linux__
+    std::println("Starting Process Capture Test...");
+    // Both streams land in one file, in the order they were written.
+    auto child = process_spawn({"sh", "-c", "echo out; echo err >&2; exit 3"}, std::nullopt, std::nullopt, true);
+    if (!child) {
+        std::println(std::cerr, "Failed to spawn: {}", child.error());
+        return false;
+    }
+    auto res = process_wait(*child);
+    if (!res || *res != 3 || child->output != "out\nerr\n" || child->output_fd != -1) {
+        std::println(
+            std::cerr, "Captured '{}' (exit code {}), expected 'out', 'err' and 3", child->output, res.value_or(-1));
+        return false;
+    }
+    std::println("Process Capture Test passed!");
+#endif
+    return true;
+}
@@ -0,0 +1,107 @@
+#include "tests/test_suite.hpp"
+
+#include "cbe/scan.hpp"
+
+#include <cstddef>
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+
+using namespace catalyst;
+
+namespace {
+
+// Longer than two AVX2 blocks plus an SSE2 block, so every size exercises a different mix of
+// vector steps and scalar tail.
+constexpr size_t TUNABLE__max_size = 100;
+
+size_t scalar_pipe_or_newline(std::string_view text, size_t pos) {
+    while (pos < text.size() && text[pos] != '|' && text[pos] != '\n')
+        pos++;
+    return pos;
+}
+
+size_t scalar_depfile_break(std::string_view text, size_t pos) {
+    while (pos < text.size() && static_cast<unsigned char>(text[pos]) > ' ' && text[pos] != '\\')
+        pos++;
+    return pos;
+}
+
+/**
+ * @brief Compares a kernel with its scalar reference from every start position in `text`.
+ * @param what The kernel's name, for the failure message.
+ */
+template <typename Kernel, typename Reference>
+bool matches(std::string_view what, Kernel kernel, Reference reference, std::string_view text) {
+    for (size_t pos = 0; pos <= text.size(); ++pos) {
+        const size_t got = kernel(text, pos);
+        const size_t expected = reference(text, pos);
+        if (got != expected) {
+            std::println(
+                std::cerr, "{}: size {} from {} found {}, expected {}", what, text.size(), pos, got, expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_kernels(std::string_view text) {
+    return matches("find_pipe_or_newline", find_pipe_or_newline, scalar_pipe_or_newline, text) &&
+           matches("find_depfile_break", find_depfile_break, scalar_depfile_break, text);
+}
+
+/**
+ * @brief Places each delimiter, and each byte a wrong comparison would mistake for one, at
+ * every position of every size, so matches land on and around block boundaries and in tails.
+ */
+bool check_single_bytes() {
+    // Bytes above 0x7f would be below ' ' if compared as signed; '{' and '[' neighbour '|' and '\\'.
+    constexpr std::string_view specials = {"|\n \t\\\0\x01\x1f!\x7f\x80\xff{[", 14};
+    // An offset into `buffer` makes the text unaligned.
+    std::string buffer(TUNABLE__max_size + 1, 'a');
+    for (size_t size = 0; size <= TUNABLE__max_size; ++size) {
+        const std::string_view text(buffer.data() + 1, size);
+        if (!check_kernels(text))
+            return false;
+        for (size_t at = 0; at < size; ++at) {
+            for (char special : specials) {
+                buffer[1 + at] = special;
+                const bool ok = check_kernels(text);
+                buffer[1 + at] = 'a';
+                if (!ok)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool check_random_texts() {
+    std::mt19937 rng(14);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (int round = 0; round < 2000; ++round) {
+        std::string text(rng() % (TUNABLE__max_size * 3), '\0');
+        // Sparse delimiters in mostly path-like bytes, as in real manifests and depfiles.
+        for (auto &c : text)
+            c = rng() % 16 == 0 ? static_cast<char>(byte(rng)) : static_cast<char>('a' + rng() % 26);
+        if (!check_kernels(text))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool scan_test() {
+    std::println("Starting Scan Test ({} kernels)...", scan_kernel_name());
+    if (find_pipe_or_newline({}) != 0 || find_depfile_break({}) != 0) {
+        std::println(std::cerr, "Scanning empty text did not return its size");
+        return false;
+    }
+    if (!check_single_bytes() || !check_random_texts())
+        return false;
+    std::println("Scan Test passed!");
+    return true;
+}
@@ -0,0 +1,192 @@
+#include "tests/test_suite.hpp"
+
+#include "cbe/scheduler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+
+struct TestDag {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> successors;
+    std::vector<size_t> priorities;
+    std::vector<std::vector<uint32_t>> predecessors;
+
+    Scheduler::Dag view() const {
+        return {.offsets = offsets, .successors = successors, .priorities = priorities};
+    }
+};
+
+// Random DAG: edges only go from lower to higher ids, so it is acyclic.
+TestDag random_dag(uint32_t num_tasks, uint32_t max_fanout, uint32_t seed) {
+    std::mt19937 rng(seed);
+    TestDag dag;
+    dag.predecessors.resize(num_tasks);
+    dag.offsets.push_back(0);
+    for (uint32_t u = 0; u < num_tasks; ++u) {
+        if (u + 1 < num_tasks) {
+            uint32_t fanout = rng() % (max_fanout + 1);
+            for (uint32_t k = 0; k < fanout; ++k) {
+                uint32_t v = u + 1 + (rng() % (num_tasks - u - 1));
+                dag.successors.push_back(v);
+                dag.predecessors[v].push_back(u);
+            }
+        }
+        dag.offsets.push_back(static_cast<uint32_t>(dag.successors.size()));
+        dag.priorities.push_back(rng() % 1000);
+    }
+    return dag;
+}
+
+bool run_exactly_once(uint32_t num_tasks, uint32_t max_fanout, size_t workers, uint32_t seed) {
+    TestDag dag = random_dag(num_tasks, max_fanout, seed);
+    auto runs = std::make_unique<std::atomic<uint32_t>[]>(num_tasks);
+    auto finished = std::make_unique<std::atomic<bool>[]>(num_tasks);
+    std::atomic<bool> order_violated = false;
+
+    Scheduler scheduler(dag.view(), workers);
+    auto res = scheduler.run([&](uint32_t task) {
+        for (uint32_t pred : dag.predecessors[task]) {
+            if (!finished[pred].load())
+                order_violated = true;
+        }
+        runs[task].fetch_add(1);
+        finished[task].store(true);
+        return true;
+    });
+
+    if (!res) {
+        std::println(std::cerr, "Scheduler failed on an acyclic graph: {}", res.error());
+        return false;
+    }
+    if (order_violated) {
+        std::println(std::cerr, "A task ran before one of its dependencies");
+        return false;
+    }
+    for (uint32_t i = 0; i < num_tasks; ++i) {
+        if (runs[i].load() != 1) {
+            std::println(std::cerr, "Task {} ran {} times", i, runs[i].load());
+            return false;
+        }
+    }
+    return scheduler.completed() == num_tasks;
+}
+
+} // namespace
+
+bool scheduler_stress_test() {
+    std::println("Starting Scheduler Stress Test...");
+
+    // Wide and deep graphs, more workers than cores, and a single worker.
+    for (uint32_t seed = 0; seed < 20; ++seed) {
+        if (!run_exactly_once(20000, 4, 32, seed))
+            return false;
+    }
+    if (!run_exactly_once(5000, 1, 8, 42))
+        return false;
+    if (!run_exactly_once(5000, 16, 1, 7))
+        return false;
+
+    // Star: one root releasing thousands of tasks at once.
+    {
+        TestDag star;
+        constexpr uint32_t leaves = 10000;
+        star.offsets = {0, leaves};
+        for (uint32_t i = 1; i <= leaves; ++i) {
+            star.successors.push_back(i);
+            star.offsets.push_back(leaves);
+        }
+        std::atomic<uint32_t> ran = 0;
+        Scheduler scheduler({.offsets = star.offsets, .successors = star.successors, .priorities = {}}, 64);
+        if (!scheduler.run([&](uint32_t) {
+                ran.fetch_add(1);
+                return true;
+            }) ||
+            ran.load() != leaves + 1) {
+            std::println(std::cerr, "Star graph did not run every task once");
+            return false;
+        }
+    }
+
+    // Resources: a pool of 2 slots for the even tasks, and a budget of 10 units that task 1
+    // alone exceeds. Limits must hold, and the oversized task must still run.
+    {
+        TestDag dag = random_dag(2000, 2, 3);
+        std::vector<size_t> capacities = {10, 2};
+        std::vector<uint32_t> offsets = {0};
+        std::vector<Scheduler::Demand> demands;
+        for (uint32_t task = 0; task < 2000; ++task) {
+            demands.push_back({.resource = 0, .amount = task == 1 ? 50 : task % 5});
+            if (task % 2 == 0)
+                demands.push_back({.resource = 1, .amount = 1});
+            offsets.push_back(static_cast<uint32_t>(demands.size()));
+        }
+        std::atomic<size_t> memory = 0;
+        std::atomic<size_t> pooled = 0;
+        std::atomic<uint32_t> ran = 0;
+        std::atomic<bool> exceeded = false;
+        Scheduler scheduler(dag.view(), 16, {.capacities = capacities, .offsets = offsets, .demands = demands});
+        auto res = scheduler.run([&](uint32_t task) {
+            const size_t amount = task == 1 ? 50 : task % 5;
+            if (memory.fetch_add(amount) + amount > 10 && task != 1)
+                exceeded = true;
+            if (task % 2 == 0 && pooled.fetch_add(1) + 1 > 2)
+                exceeded = true;
+            std::this_thread::yield();
+            if (task % 2 == 0)
+                pooled.fetch_sub(1);
+            memory.fetch_sub(amount);
+            ran.fetch_add(1);
+            return true;
+        });
+        if (!res || exceeded || ran.load() != 2000) {
+            std::println(std::cerr, "Resource limits were not honored (ran {} tasks)", ran.load());
+            return false;
+        }
+    }
+
+    // Cycle: 0 -> 1 -> 2 -> 1, plus an independent task 3. Must stall, not hang.
+    {
+        std::vector<uint32_t> offsets = {0, 1, 2, 3, 3};
+        std::vector<uint32_t> successors = {1, 2, 1};
+        std::atomic<uint32_t> ran = 0;
+        Scheduler scheduler({.offsets = offsets, .successors = successors, .priorities = {}}, 4);
+        auto res = scheduler.run([&](uint32_t) {
+            ran.fetch_add(1);
+            return true;
+        });
+        if (res || ran.load() != 2) {
+            std::println(std::cerr, "Cycle was not detected (ran {} tasks)", ran.load());
+            return false;
+        }
+    }
+
+    // Failure: nothing downstream of a failed task may run.
+    {
+        std::vector<uint32_t> offsets = {0, 1, 2, 2};
+        std::vector<uint32_t> successors = {1, 2};
+        std::atomic<bool> downstream_ran = false;
+        Scheduler scheduler({.offsets = offsets, .successors = successors, .priorities = {}}, 4);
+        auto res = scheduler.run([&](uint32_t task) {
+            if (task == 2)
+                downstream_ran = true;
+            return task != 1;
+        });
+        if (res || downstream_ran) {
+            std::println(std::cerr, "Failure did not stop the schedule");
+            return false;
+        }
+    }
+
+    std::println("Scheduler Stress Test passed!");
+    return true;
+}
@@ -3,5 +3,7 @@
 #include <cassert>
 
 int main(int argc, char **argv) {
-    return !(integration_test() && opaque_deps_test());
+    return !(integration_test() && opaque_deps_test() && scheduler_stress_test() && deps_log_test() &&
+             early_cutoff_test() && artifact_cache_test() && digest_cache_test() && scan_test() &&
+             process_capture_test());
 }
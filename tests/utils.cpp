@@ -1,7 +1,29 @@
+#include "tests/testing_utils.hpp"
+
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
 
 void create_dummy_file(const std::string &name) {
     std::ofstream f(name);
     f << "int main() {}";
     f.close();
 }
+
+void write_file(const std::filesystem::path &path, std::string_view content) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << content;
+}
+
+bool with_scratch_dir(const std::filesystem::path &name, const std::function<bool()> &fn) {
+    const std::filesystem::path cwd = std::filesystem::current_path();
+    std::filesystem::remove_all(name);
+    std::filesystem::create_directory(name);
+    std::filesystem::current_path(name);
+    const bool ok = fn();
+    std::filesystem::current_path(cwd);
+    std::filesystem::remove_all(name);
+    return ok;
+}